@@ -0,0 +1,113 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Analytics.h"
+#include "Parallel.h"
+#include "Log.h"
+#include <math.h>
+#include <sstream>
+
+// workerSums layout: centred squared distance, heading sums, box
+#define S_R2 0
+#define S_HX 1
+#define S_HY 2
+#define S_HZ 3
+#define S_MIN 4
+#define S_MAX 7
+#define S_COUNT 10
+
+std::string Analytics::header() {
+	std::ostringstream ss;
+	ss << "# step\tlevel\tcount\tgyration\tpolarization\tmin_x\tmin_y\tmin_z\tmax_x\tmax_y\tmax_z"
+		<< "\tcaptures_per_step\tnearest_predator_bins_of_" << HIST_WIDTH;
+	return ss.str();
+}
+
+void Analytics::sample(unsigned int step, std::vector<FlockItem>& flocks,
+		const std::vector<ProximityPass>& proximity) {
+	TRACE_SCOPE("analytics");
+	const unsigned int steps = step > lastStep ? step - lastStep : 1;
+	lastStep = step;
+	lastEaten.resize(flocks.size(), 0);
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		FlockItem& me = flocks[f];
+		const unsigned int n = me.getAmnt();
+		const float* x = me.getPosXPtr();
+		const float* y = me.getPosYPtr();
+		const float* z = me.getPosZPtr();
+		const float* hx = me.getHeadXPtr();
+		const float* hy = me.getHeadYPtr();
+		const float* hz = me.getHeadZPtr();
+		const float cx = me.getAvePosX(), cy = me.getAvePosY(), cz = me.getAvePosZ();
+		// the pass only covers this flock as it is now if nothing was eaten since
+		const ProximityPass* pred = (f + 1 < flocks.size() && proximity[f + 1].getPredCount() > 0
+			&& proximity[f + 1].getPreyCount() == n) ? &proximity[f + 1] : NULL;
+		const float* dist2 = pred != NULL ? pred->getNearestPredDist2() : NULL;
+
+		const unsigned int workers = chunkWorkers(n);
+		workerSums.resize(workers);
+		workerHist.resize(workers);
+		parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+			std::vector<double>& s = workerSums[w];
+			std::vector<unsigned int>& hist = workerHist[w];
+			s.assign(S_COUNT, 0.0);
+			hist.assign(HIST_BINS, 0);
+			for (int k = 0; k < 3; k++) {
+				s[S_MIN + k] = 99999999.9;
+				s[S_MAX + k] = -99999999.9;
+			}
+			for (unsigned int i = b; i < e; i++) {
+				float dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+				s[S_R2] += (dx * dx) + (dy * dy) + (dz * dz);
+				s[S_HX] += hx[i];
+				s[S_HY] += hy[i];
+				s[S_HZ] += hz[i];
+				s[S_MIN] = x[i] < s[S_MIN] ? x[i] : s[S_MIN];
+				s[S_MIN + 1] = y[i] < s[S_MIN + 1] ? y[i] : s[S_MIN + 1];
+				s[S_MIN + 2] = z[i] < s[S_MIN + 2] ? z[i] : s[S_MIN + 2];
+				s[S_MAX] = x[i] > s[S_MAX] ? x[i] : s[S_MAX];
+				s[S_MAX + 1] = y[i] > s[S_MAX + 1] ? y[i] : s[S_MAX + 1];
+				s[S_MAX + 2] = z[i] > s[S_MAX + 2] ? z[i] : s[S_MAX + 2];
+				if (dist2 != NULL) {
+					unsigned int bin = (unsigned int) (sqrt(dist2[i]) / HIST_WIDTH);
+					hist[bin < HIST_BINS ? bin : HIST_BINS - 1]++;
+				}
+			}
+		});
+		std::vector<double>& total = workerSums[0];
+		for (unsigned int w = 1; w < workers; w++) {
+			for (int k = 0; k < S_MIN; k++) {
+				total[k] += workerSums[w][k];
+			}
+			for (int k = 0; k < 3; k++) {
+				total[S_MIN + k] = workerSums[w][S_MIN + k] < total[S_MIN + k] ? workerSums[w][S_MIN + k] : total[S_MIN + k];
+				total[S_MAX + k] = workerSums[w][S_MAX + k] > total[S_MAX + k] ? workerSums[w][S_MAX + k] : total[S_MAX + k];
+			}
+			for (int k = 0; k < HIST_BINS; k++) {
+				workerHist[0][k] += workerHist[w][k];
+			}
+		}
+
+		std::ostringstream ss;
+		ss << step << "\t" << me.getLevel() << "\t" << n;
+		if (n == 0) {
+			ss << "\t0\t0\t0\t0\t0\t0\t0\t0";
+		} else {
+			ss << "\t" << sqrt(total[S_R2] / n) << "\t"
+				<< sqrt((total[S_HX] * total[S_HX]) + (total[S_HY] * total[S_HY]) + (total[S_HZ] * total[S_HZ])) / n;
+			for (int k = 0; k < 6; k++) {
+				ss << "\t" << total[S_MIN + k];
+			}
+		}
+		unsigned long eaten = me.getEatenTotal();
+		ss << "\t" << (double) (eaten - lastEaten[f]) / steps << "\t";
+		lastEaten[f] = eaten;
+		if (dist2 == NULL) {
+			ss << "-";
+		} else {
+			for (int k = 0; k < HIST_BINS; k++) {
+				ss << (k == 0 ? "" : ",") << workerHist[0][k];
+			}
+		}
+		Log::text(Log::STATS_FILE, ss.str());
+	}
+}
@@ -0,0 +1,40 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "FlockItem.h"
+#include "ProximityPass.h"
+#include <string>
+#include <vector>
+#pragma once
+
+// nearest predator distances binned in steps of HIST_WIDTH, the last bin
+// also takes everything further away
+#define HIST_BINS 16
+#define HIST_WIDTH 0.125f
+// steps between two samples, CLHandler takes one when its step count is a
+// multiple of this
+#define ANALYTICS_PERIOD 16
+
+// Population statistics taken during the step instead of from dumped
+// trajectories. Each sample is one line per flock in the STATS_FILE log sink:
+// step, level, count, radius of gyration, polarization (length of the mean
+// heading, 1 when every member heads the same way), the bounding box, how
+// many members were eaten per step since the last sample, and for flocks
+// with a predator flock the histogram of distances to the nearest predator.
+class Analytics {
+private:
+	unsigned int lastStep;
+	// every flock's getEatenTotal at the last sample
+	std::vector<unsigned long> lastEaten;
+	// per worker sums over one flock, see sample
+	std::vector<std::vector<double> > workerSums;
+	std::vector<std::vector<unsigned int> > workerHist;
+public:
+	Analytics() : lastStep(0) {}
+
+	// the column names, the first line of the file
+	static std::string header();
+	// proximity is the step's passes, see CLHandler::calcProximity. Needs the
+	// flocks' heading caches.
+	void sample(unsigned int step, std::vector<FlockItem>& flocks,
+		const std::vector<ProximityPass>& proximity);
+};
@@ -1,7 +1,7 @@
-#pragma OPENCL EXTENSION cl_khr_fp64 : enable __kernel
-void align( __gloabal float* rotT, __gloabal float* rotE, __global float* aveRot,
+__kernel
+void align(__global float* rotT, __global float* rotE, __global float* aveRot,
     int size, __global float* alignT, __global float* alignE) {
-	size_t i = get_local_id(0);
+	size_t i = get_global_id(0);
 	if (i < size) {
 		float theta, epsilon;
 		theta = aveRot[0] - rotT[i];
@@ -11,4 +11,4 @@ void align( __gloabal float* rotT, __gloabal float* rotE, __global float* aveRot
 		alignE[i] = epsilon;
 		alignT[i] = theta;
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+// The six behaviors for every member of every simulation of an Ensemble in
+// one launch each. The members of all the flocks are packed one flock after
+// another, owner[i] is the flock member i is in, and per flock seg holds
+// SEG_INTS ints: its first member, its member count, its prey's flock and
+// its predator's flock, -1 when it has none. aves holds SEG_FLOATS floats
+// per flock: its average x, y, z, theta and epsilon. Each kernel writes its
+// turns at slot * total in t and e.
+#define SEG_INTS 4
+#define SEG_FLOATS 5
+
+// The angle between a and the heading projected on epsilon = 0 and on
+// theta = 0, the same as steerAngles in StepBackend.h.
+void steerAngles(float ax, float ay, float az, float vel, float rotT, float rotE,
+    float* theta, float* epsilon) {
+	float a = sqrt((ax * ax) + (ay * ay) + (az * az));
+	float b = fabs(vel);
+	*theta = 0.0f;
+	*epsilon = 0.0f;
+	if (a == 0.0f || b == 0.0f) {
+		return;
+	}
+	// 0 E: b = vel * (sin(T), 0, cos(T))
+	float c = ((ax * sin(rotT)) + (az * cos(rotT))) * vel / (a * b);
+	*theta = acos(clamp(c, -1.0f, 1.0f));
+	// 0 T: b = vel * (0, 0, 1)
+	c = az * vel / (a * b);
+	*epsilon = acos(clamp(c, -1.0f, 1.0f));
+	*theta = fmod(*theta, 3.14f); // theta % 3.14f;
+	*epsilon = fmod(*epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+}
+
+// index of the closest point in [first, first + n), the first one on ties
+int nearestIndex(__global float* x, __global float* y, __global float* z, int first, int n,
+    float px, float py, float pz) {
+	float dist = 99999999.9f; // large float
+	int index = first;
+	for (int j = first; j < first + n; j++) {
+		float dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		float myDist = (dx * dx) + (dy * dy) + (dz * dz);
+		if (myDist < dist) {
+			dist = myDist;
+			index = j;
+		}
+	}
+	return index;
+}
+
+// turn towards the closest member of flock other, none when it is -1 or empty
+void towardsNearest(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* seg, int other, size_t i, float* theta, float* epsilon) {
+	*theta = 0.0f;
+	*epsilon = 0.0f;
+	if (other >= 0 && seg[(other * SEG_INTS) + 1] > 0) {
+		int k = nearestIndex(posX, posY, posZ, seg[other * SEG_INTS], seg[(other * SEG_INTS) + 1],
+			posX[i], posY[i], posZ[i]);
+		steerAngles(posX[k] - posX[i], posY[k] - posY[i], posZ[k] - posZ[i],
+			vel[i], rotT[i], rotE[i], theta, epsilon);
+	}
+}
+
+__kernel
+void huntBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		float theta, epsilon;
+		towardsNearest(posX, posY, posZ, rotT, rotE, vel, seg, seg[(owner[i] * SEG_INTS) + 2], i,
+			&theta, &epsilon);
+		t[(slot * total) + i] = theta;
+		e[(slot * total) + i] = epsilon;
+	}
+}
+
+__kernel
+void hideFromHunterBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		float theta, epsilon;
+		towardsNearest(posX, posY, posZ, rotT, rotE, vel, seg, seg[(owner[i] * SEG_INTS) + 3], i,
+			&theta, &epsilon);
+		t[(slot * total) + i] = -theta;
+		e[(slot * total) + i] = -epsilon;
+	}
+}
+
+__kernel
+void hideFromHuntersBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		float theta = 0.0f, epsilon = 0.0f;
+		int pred = seg[(owner[i] * SEG_INTS) + 3];
+		if (pred >= 0) {
+			__global float* ave = aves + (pred * SEG_FLOATS);
+			steerAngles(ave[0] - posX[i], ave[1] - posY[i], ave[2] - posZ[i],
+				vel[i], rotT[i], rotE[i], &theta, &epsilon);
+		}
+		t[(slot * total) + i] = -theta;
+		e[(slot * total) + i] = -epsilon;
+	}
+}
+
+__kernel
+void alignBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		__global float* ave = aves + (owner[i] * SEG_FLOATS);
+		float theta, epsilon;
+		theta = ave[3] - rotT[i];
+		epsilon = ave[4] - rotE[i];
+		theta = fmod(theta, 3.14f); // theta % 3.14f;
+		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+		t[(slot * total) + i] = theta;
+		e[(slot * total) + i] = epsilon;
+	}
+}
+
+__kernel
+void seperateBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		__global float* ave = aves + (owner[i] * SEG_FLOATS);
+		float theta, epsilon;
+		steerAngles(ave[0] - posX[i], ave[1] - posY[i], ave[2] - posZ[i],
+			vel[i], rotT[i], rotE[i], &theta, &epsilon);
+		t[(slot * total) + i] = -theta;
+		e[(slot * total) + i] = -epsilon;
+	}
+}
+
+__kernel
+void cohesionBatch(__global float* posX, __global float* posY, __global float* posZ,
+    __global float* rotT, __global float* rotE, __global float* vel,
+    __global int* owner, __global int* seg, __global float* aves,
+    int total, int slot, __global float* t, __global float* e) {
+	size_t i = get_global_id(0);
+	if (i < total) {
+		__global float* ave = aves + (owner[i] * SEG_FLOATS);
+		float theta, epsilon;
+		steerAngles(ave[0] - posX[i], ave[1] - posY[i], ave[2] - posZ[i],
+			vel[i], rotT[i], rotE[i], &theta, &epsilon);
+		t[(slot * total) + i] = theta;
+		e[(slot * total) + i] = epsilon;
+	}
+}
@@ -1,61 +1,55 @@
-#pragma OPENCL EXTENSION cl_khr_fp64 : enable __kernel
+// The angle between a and the heading projected on epsilon = 0 and on
+// theta = 0, the same as steerAngles in StepBackend.h.
+void steerAngles(float ax, float ay, float az, float vel, float rotT, float rotE,
+    float* theta, float* epsilon) {
+	float a = sqrt((ax * ax) + (ay * ay) + (az * az));
+	float b = fabs(vel);
+	*theta = 0.0f;
+	*epsilon = 0.0f;
+	if (a == 0.0f || b == 0.0f) {
+		return;
+	}
+	// 0 E: b = vel * (sin(T), 0, cos(T))
+	float c = ((ax * sin(rotT)) + (az * cos(rotT))) * vel / (a * b);
+	*theta = acos(clamp(c, -1.0f, 1.0f));
+	// 0 T: b = vel * (0, 0, 1)
+	c = az * vel / (a * b);
+	*epsilon = acos(clamp(c, -1.0f, 1.0f));
+	*theta = fmod(*theta, 3.14f); // theta % 3.14f;
+	*epsilon = fmod(*epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+}
+
+// index of the closest point, the first one on ties
+int nearestIndex(__global float* x, __global float* y, __global float* z, int n,
+    float px, float py, float pz) {
+	float dist = 99999999.9f; // large float
+	int index = 0;
+	for (int j = 0; j < n; j++) {
+		float dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		float myDist = (dx * dx) + (dy * dy) + (dz * dz);
+		if (myDist < dist) {
+			dist = myDist;
+			index = j;
+		}
+	}
+	return index;
+}
+
+__kernel
 void hideFromHunter(__global float* posX, __global float* posY,
-    __global float* posZ, __gloabal float* rotT,
-    __gloabal float* rotE __global float* vel, __global float* predPosX,
+    __global float* posZ, __global float* rotT,
+    __global float* rotE, __global float* vel, __global float* predPosX,
     __global float* predPosY, __global float* predPosZ, int sizePrey,
-    int sizePred __global float* hideT, __gobal float* hideE) {
-    
-	size_t i = get_local_id(0);
+    int sizePred, __global float* hideT, __global float* hideE) {
+	size_t i = get_global_id(0);
 	if (i < sizePrey) {
-        float theta, epsilon;
-		float a, b, c;
-		float ax, ay, az, bx, by, bz, cx, cy, cz;
-		float dist = 99999999.9f; // large float
-		int index = 0;
-        for (int j = 0; i < sizePred; j++) {
-            float myDist = sqrt(
-                ((posX[i] - predPosX[j]) * (posX[i] - predPosX[j])) +
-                ((posY[i] - predPosY[j]) * (posY[i] - predPosY[j])) +
-                ((posZ[i] - predPosZ[j]) * (posZ[i] - predPosZ[j])));
-            if (myDist < dist) {
-                index = j;
-            }
-        }
-		
-		// 0 E
-		ax = predPosX[index] - posX[i];
-		ay = predPosY[index] - posY[i];
-		az = predPosZ[index] - posZ[i];
-		bx = vel[i] * (sin(rotT[i]) * cos(0.0f));
-		by = vel[i] * (sin(rotT[i]) * sin(0.0f));
-		bz = vel[i] * cos(rotT[i]);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		// 0 T
-		bx = vel[i] * (sin(0.0f) * cos(rotE[i]));
-		by = vel[i] * (sin(0.0f) * sin(rotE[i]));
-		bz = vel[i] * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		huntE[i] = -epsilon;
-		huntT[i] = -theta;
+		float theta = 0.0f, epsilon = 0.0f;
+		if (sizePred > 0) {
+			int index = nearestIndex(predPosX, predPosY, predPosZ, sizePred, posX[i], posY[i], posZ[i]);
+			steerAngles(predPosX[index] - posX[i], predPosY[index] - posY[i], predPosZ[index] - posZ[i],
+				vel[i], rotT[i], rotE[i], &theta, &epsilon);
+		}
+		hideE[i] = -epsilon;
+		hideT[i] = -theta;
 	}
-}
\ No newline at end of file
+}
@@ -1,60 +1,54 @@
-#pragma OPENCL EXTENSION cl_khr_fp64 : enable __kernel
+// The angle between a and the heading projected on epsilon = 0 and on
+// theta = 0, the same as steerAngles in StepBackend.h.
+void steerAngles(float ax, float ay, float az, float vel, float rotT, float rotE,
+    float* theta, float* epsilon) {
+	float a = sqrt((ax * ax) + (ay * ay) + (az * az));
+	float b = fabs(vel);
+	*theta = 0.0f;
+	*epsilon = 0.0f;
+	if (a == 0.0f || b == 0.0f) {
+		return;
+	}
+	// 0 E: b = vel * (sin(T), 0, cos(T))
+	float c = ((ax * sin(rotT)) + (az * cos(rotT))) * vel / (a * b);
+	*theta = acos(clamp(c, -1.0f, 1.0f));
+	// 0 T: b = vel * (0, 0, 1)
+	c = az * vel / (a * b);
+	*epsilon = acos(clamp(c, -1.0f, 1.0f));
+	*theta = fmod(*theta, 3.14f); // theta % 3.14f;
+	*epsilon = fmod(*epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+}
+
+// index of the closest point, the first one on ties
+int nearestIndex(__global float* x, __global float* y, __global float* z, int n,
+    float px, float py, float pz) {
+	float dist = 99999999.9f; // large float
+	int index = 0;
+	for (int j = 0; j < n; j++) {
+		float dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		float myDist = (dx * dx) + (dy * dy) + (dz * dz);
+		if (myDist < dist) {
+			dist = myDist;
+			index = j;
+		}
+	}
+	return index;
+}
+
+__kernel
 void hunt(__global float* posX, __global float* posY,__global float* posZ,
-    __gloabal float* rotT, __gloabal float* rotE __global float* vel,
+    __global float* rotT, __global float* rotE, __global float* vel,
     __global float* preyX, __global float* preyY,__global float* preyZ,
     int sizeHunter, int sizePrey, __global float* huntT, __global float* huntE) {
-	
-    size_t i = get_local_id(0);
+	size_t i = get_global_id(0);
 	if (i < sizeHunter) {
-        float dist = 99999999.9f; // large float
-		int index = 0;
-        for (int j = 0; j < sizePrey; j++) {
-            float myDist = sqrt(
-                ((posX[i] - preyX[j]) * (posX[i] - preyX[j])) +
-                ((posY[i] - preyY[j]) * (posY[i] - preyY[j])) +
-                ((posZ[i] - preyZ[j]) * (posZ[i] - preyZ[j])));
-            if (myDist < dist) {
-                index = j;
-            }
-        }
-        float theta, epsilon;
-		float a, b, c;
-		float ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = preyX[index] - posX[i];
-		ay = preyY[index] - posY[i];
-		az = preyZ[index] - posZ[i];
-		
-		// 0 E
-		bx = vel[i] * (sin(rotT[i]) * cos(0.0f));
-		by = vel[i] * (sin(rotT[i]) * sin(0.0f));
-		bz = vel[i] * cos(rotT[i]);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		// 0 T
-		bx = vel[i] * (sin(0.0f) * cos(rotE[i]));
-		by = vel[i] * (sin(0.0f) * sin(rotE[i]));
-		bz = vel[i] * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+		float theta = 0.0f, epsilon = 0.0f;
+		if (sizePrey > 0) {
+			int index = nearestIndex(preyX, preyY, preyZ, sizePrey, posX[i], posY[i], posZ[i]);
+			steerAngles(preyX[index] - posX[i], preyY[index] - posY[i], preyZ[index] - posZ[i],
+				vel[i], rotT[i], rotE[i], &theta, &epsilon);
+		}
 		huntE[i] = epsilon;
 		huntT[i] = theta;
 	}
-}
\ No newline at end of file
+}
@@ -1,570 +1,492 @@
 #include "CLHandler.h"
+#include "Parallel.h"
+#include "Weights.h"
+#include "Log.h"
 #include <math.h>
 #include <vector>
 #pragma once
 
 typedef std::vector<float> floats;
 
-#define HUNT_W 0.01
-#define HIDE_FROM_ONE_W 0.01
-#define HIDE_FROM_ALL_W 0.01
-#define ALIGN_W 0.004
-#define SEPERATE_W 0.004
-#define COHESION_W 0.006
+// only used with LOCAL_FLOCKING
+#define PERCEPTION_RADIUS 0.25f
+// only used with MORTON_REORDER
+#define REORDER_PERIOD 32
+// only used with OCTREE_FIELDS. A node is one particle when its size is less
+// than OPENING_ANGLE times its distance, 0 is exact and large is the centroid.
+#define OPENING_ANGLE 0.5f
 
-// #define OPENCL
-
-#ifdef OPENCL
-int getDevType(const std::string& device) throw(std::runtime_error) {
-    const std::string DevTypes = "CPUGPUACC";
-    switch (DevTypes.find(device)) {
-    case 0: return CL_DEVICE_TYPE_CPU;
-    case 3: return CL_DEVICE_TYPE_GPU;
-    case 6: return CL_DEVICE_TYPE_ACCELERATOR;
-    }
-    throw std::runtime_error("Invalid device type specified");
-}
-#endif
-
-CLHandler::CLHandler(std::vector<FlockItem>* flocks, std::vector<std::string>& kerenelFile,
-		std::vector<std::string>& kernelFuncts, std::string mode) {
+CLHandler::CLHandler(std::vector<FlockItem>* flocks, const std::vector<std::string>& kernelFiles,
+		const std::vector<std::string>& kernelFuncts, const std::string& mode) {
 	particles = flocks;
+	steps = 0;
+	steerPeriod = 1;
+	nearestApproximation = 0.0f;
+	globalSums = NULL;
 	resetAverages();
-#ifdef OPENCL
-	int type = getDevType(mode);
-	for (unsigned int i =0; i < kernelFuncts.size(); i++) {
-		queues.push_back(ClCmdQueue(type));
-		kernels.push_back(queues[i].loadKernel(kerenelFile[i], kernelFuncts[i]));
-	}
+	BackendArgs args;
+	args.kernelFiles = kernelFiles;
+	args.kernelFuncts = kernelFuncts;
+	backend = makeBackend(mode, args);
+#ifdef CARTESIAN
+	Log::text(Log::CONSOLE, "CARTESIAN steers the direction vectors itself, the " + backend->getName()
+		+ " backend is not used");
 #endif
 }
 
 void CLHandler::resetAverages() {
-	avePosX = floats(particles->size(), 0.0f);
-	avePosY = floats(particles->size(), 0.0f);
-	avePosZ = floats(particles->size(), 0.0f);
-	aveRotE = floats(particles->size(), 0.0f);
-	aveRotT = floats(particles->size(), 0.0f);
+	// assign keeps the capacity, so this only allocates when flocks are added
+	avePosX.assign(particles->size(), 0.0f);
+	avePosY.assign(particles->size(), 0.0f);
+	avePosZ.assign(particles->size(), 0.0f);
+	aveRotE.assign(particles->size(), 0.0f);
+	aveRotT.assign(particles->size(), 0.0f);
+#ifdef CARTESIAN
+	aveDirX.assign(particles->size(), 0.0f);
+	aveDirY.assign(particles->size(), 0.0f);
+	aveDirZ.assign(particles->size(), 0.0f);
+#endif
 }
 
 void CLHandler::calcAverages() {
+	TRACE_SCOPE("averages");
 	resetAverages();
+	// the flocks keep running totals, so no pass over the particles is needed
 	for (unsigned int i = 0; i < particles->size();i++) {
-#ifdef OPENCL
-		floats avePos, aveRot;
-		avePos = floats(3, 0.0f);
-		aveRot = floats(3, 0.0f);
-		cl::Buffer pxBuff = queues[0].makeBuffer(&(particles->at(i).getPosX()[0]), sizeof(float) * particles->at(i).getAmnt(), queues[0].ROFlags);
-		cl::Buffer pyBuff = queues[0].makeBuffer(&(particles->at(i).getPosY()[0]), sizeof(float) * particles->at(i).getAmnt(), queues[0].ROFlags);
-		cl::Buffer pzBuff = queues[0].makeBuffer(&(particles->at(i).getPosZ()[0]), sizeof(float) * particles->at(i).getAmnt(), queues[0].ROFlags);
-		cl::Buffer avePosBuff = queues[0].makeBuffer(&(avePos[0]), sizeof(float) * avePos.size(), queues[0].ROFlags);
-		cl::Buffer aveRotBuff = queues[0].makeBuffer(&(aveRot[0]), sizeof(float) * aveRot.size(), queues[0].ROFlags);
-		cl::NDRange globalRange(particles->at(i).getAmnt());
-		cl::KernelFunctor funct(kernels[0], queues[0].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-		funct(pxBuff, pyBuff, pzBuff, avePosBuff, aveRotBuff, particles->at(i).getAmnt());
-		queues[0].getQueue().enqueueMapBuffer(avePosBuff, CL_TRUE, CL_MAP_READ, 0, 3 * sizeof(float));
-		queues[0].getQueue().enqueueMapBuffer(aveRotBuff, CL_TRUE, CL_MAP_READ, 0, 2 * sizeof(float));
-		
-		avePosX[i] = avePos[0];
-		avePosY[i] = avePos[1];
-		avePosZ[i] = avePos[2];
-		aveRotT[i] = aveRot[0];
-		aveRotE[i] = aveRot[1];
-#endif
-
-#ifndef OPENCL
-		float x = 0.0f, y = 0.0f, z = 0.0f, e = 0.0f, t = 0.0f;
-		unsigned int size = particles->at(i).getAmnt();
-		for (unsigned int j = 0; j < size; j++) {
-			x += particles->at(i).getPosX(j);
-			y += particles->at(i).getPosY(j);
-			z += particles->at(i).getPosZ(j);
-			e += particles->at(i).getRotEpsilon(j);
-			t += particles->at(i).getRotTheta(j);
+		FlockItem& f = particles->at(i);
+		// the totals over every process, see setGlobalSums
+		const double* g = globalSums == NULL ? NULL : globalSums + (i * (FLOCK_SUMS + 1));
+		if (g != NULL && g[FLOCK_SUMS] == 0.0) {
+			continue;
 		}
-		avePosX[i] = (x / size);
-		avePosY[i] = (y / size);
-		avePosZ[i] = (z / size);
-		aveRotT[i] = (t / size);
-		aveRotE[i] = (e / size);
+		avePosX[i] = g == NULL ? f.getAvePosX() : (float) (g[0] / g[FLOCK_SUMS]);
+		avePosY[i] = g == NULL ? f.getAvePosY() : (float) (g[1] / g[FLOCK_SUMS]);
+		avePosZ[i] = g == NULL ? f.getAvePosZ() : (float) (g[2] / g[FLOCK_SUMS]);
+#ifdef CARTESIAN
+		aveDirX[i] = g == NULL ? f.getAveDirX() : (float) (g[3] / g[FLOCK_SUMS]);
+		aveDirY[i] = g == NULL ? f.getAveDirY() : (float) (g[4] / g[FLOCK_SUMS]);
+		aveDirZ[i] = g == NULL ? f.getAveDirZ() : (float) (g[5] / g[FLOCK_SUMS]);
+		// the angles are kept only for anyone reading them out
+		float len = sqrt((aveDirX[i] * aveDirX[i]) + (aveDirY[i] * aveDirY[i]) + (aveDirZ[i] * aveDirZ[i]));
+		if (len > 0.0f) {
+			aveRotT[i] = acos(aveDirZ[i] / len);
+			aveRotE[i] = atan2(aveDirY[i], aveDirX[i]);
+		}
+#else
+		aveRotT[i] = g == NULL ? f.getAveRotT() : (float) (g[3] / g[FLOCK_SUMS]);
+		aveRotE[i] = g == NULL ? f.getAveRotE() : (float) (g[4] / g[FLOCK_SUMS]);
 #endif
 	}
+	// the rest of the statistics need a pass over the particles. A process's
+	// share of a distributed run also holds ghosts, so it has none.
+	if (globalSums == NULL && steps % ANALYTICS_PERIOD == 0) {
+		analytics.sample(steps, *particles, proximity);
+	}
 }
 
-std::vector<floats> CLHandler::hunt(int myIndex, int preyIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL	
-	cl::Buffer predXBuff = queues[1].makeBuffer(&(particles->at(myIndex).getPosX()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predYBuff = queues[1].makeBuffer(&(particles->at(myIndex).getPosY()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predZBuff = queues[1].makeBuffer(&(particles->at(myIndex).getPosZ()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predRotT = queues[1].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predRotE = queues[1].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predVel = queues[1].makeBuffer(&(particles->at(myIndex).getVels()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer preyXBuff = queues[1].makeBuffer(&(particles->at(preyIndex).getPosX()[0]), sizeof(float) * particles->at(preyIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer preyYBuff = queues[1].makeBuffer(&(particles->at(preyIndex).getPosY()[0]), sizeof(float) * particles->at(preyIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer preyZBuff = queues[1].makeBuffer(&(particles->at(preyIndex).getPosZ()[0]), sizeof(float) * particles->at(preyIndex).getAmnt(), queues[1].ROFlags);
-	cl::Buffer predTBuff = queues[1].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[1].ROFlags);
-	cl::Buffer predEBuff = queues[1].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[1].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[1], queues[1].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(predXBuff, predYBuff, predZBuff, predRotT, predRotE, predVel, preyXBuff, preyYBuff, preyZBuff,  particles->at(myIndex).getAmnt(), particles->at(preyIndex).getAmnt(), predTBuff, predEBuff);
-	queues[1].getQueue().enqueueMapBuffer(predTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[1].getQueue().enqueueMapBuffer(predEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
-#endif
-
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i++) {
-		float dist = 99999999.9f; // large float
-		int index = 0;
-		for (unsigned int j = 0; j < particles->at(preyIndex).getAmnt(); j++) {
-			float myX, myY, myZ, itX, itY, itZ;
-			myX = particles->at(myIndex).getPosX(i);
-			myY = particles->at(myIndex).getPosY(i);
-			myZ = particles->at(myIndex).getPosZ(i);
-			itX = particles->at(preyIndex).getPosX(j);
-			itY = particles->at(preyIndex).getPosY(j);
-			itZ = particles->at(preyIndex).getPosZ(j);
-			float myDist = sqrt(((myX - itX) * (myX - itX)) + ((myY - itY) * (myY - itY)) + ((myZ - itZ) * (myZ - itZ)));
-			if (myDist < dist) {
-                index = j;
-            }
-		}
-		float theta, epsilon, a, b, c, ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = particles->at(preyIndex).getPosX(index) - particles->at(myIndex).getPosX(i);
-		ay = particles->at(preyIndex).getPosY(index) - particles->at(myIndex).getPosY(i);
-		az = particles->at(preyIndex).getPosZ(index) - particles->at(myIndex).getPosZ(i);
-		
-		// 0 E
-		bx = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * cos(0.0f));
-		by = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * sin(0.0f));
-		bz = particles->at(myIndex).getVels(i) * cos(particles->at(myIndex).getRotTheta(i));
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-
-		// 0 T
-		bx = particles->at(myIndex).getVels(i) * (sin(0.0f) * cos(particles->at(myIndex).getRotEpsilon(i)));
-		by = particles->at(myIndex).getVels(i) * (sin(0.0f) * sin(particles->at(myIndex).getRotEpsilon(i)));
-		bz = particles->at(myIndex).getVels(i) * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		t.push_back(theta);
-		e.push_back(epsilon);
+void CLHandler::calcProximity() {
+	TRACE_SCOPE("proximity");
+	// one pass per predator/prey pair serves hunt, hideFromClosestPackMember
+	// and eatPrey
+	proximity.resize(particles->size());
+	for (unsigned int i = 1; i < particles->size(); i++) {
+		proximity[i].build(particles->at(i), particles->at(i - 1), nearestApproximation);
 	}
-#endif
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
 }
 
-std::vector<floats> CLHandler::hideFromClosestPackMember(int myIndex, int predIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL	
-	cl::Buffer preyXBuff = queues[2].makeBuffer(&(particles->at(myIndex).getPosX()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyYBuff = queues[2].makeBuffer(&(particles->at(myIndex).getPosY()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyZBuff = queues[2].makeBuffer(&(particles->at(myIndex).getPosZ()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyRotT = queues[2].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyRotE = queues[2].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyVel = queues[2].makeBuffer(&(particles->at(myIndex).getVels()[0]), sizeof(float)* particles->at(myIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer predXBuff = queues[2].makeBuffer(&(particles->at(predIndex).getPosX()[0]), sizeof(float) * particles->at(predIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer predYBuff = queues[2].makeBuffer(&(particles->at(predIndex).getPosY()[0]), sizeof(float) * particles->at(predIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer predZBuff = queues[2].makeBuffer(&(particles->at(predIndex).getPosZ()[0]), sizeof(float) * particles->at(predIndex).getAmnt(), queues[2].ROFlags);
-	cl::Buffer preyTBuff = queues[2].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[2].ROFlags);
-	cl::Buffer preyEBuff = queues[2].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[2].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[2], queues[2].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(preyXBuff, preyYBuff, preyZBuff, preyRotT, preyRotE, preyVel, predXBuff, predYBuff,predZBuff, particles->at(myIndex).getAmnt(), particles->at(predIndex).getAmnt(), preyTBuff, preyEBuff);
-	queues[2].getQueue().enqueueMapBuffer(preyTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[2].getQueue().enqueueMapBuffer(preyEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
+#ifdef OCTREE_FIELDS
+void CLHandler::calcFields() {
+	TRACE_SCOPE("octree fields");
+	trees.resize(particles->size());
+	fields.resize(particles->size());
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		FlockItem& f = particles->at(i);
+		trees[i].build(f.getPosXPtr(), f.getPosYPtr(), f.getPosZPtr(), f.getAmnt());
+	}
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		FlockItem& me = particles->at(i);
+		Fields& f = fields[i];
+		// the same flock hides as in oneIterationOfFlocking
+		f.hide = (i == 0 && particles->size() > 1) ? arena.alloc<float>(3 * me.getAmnt()) : NULL;
+#ifdef LOCAL_FLOCKING
+		f.sep = f.coh = NULL;
+#else
+		f.sep = arena.alloc<float>(3 * me.getAmnt());
+		f.coh = arena.alloc<float>(3 * me.getAmnt());
 #endif
+		parallelFor(0, me.getAmnt(), [&](unsigned int j) {
+			float px = me.getPosX(j), py = me.getPosY(j), pz = me.getPosZ(j);
+			float near[3], far[3];
+			if (f.hide != NULL) {
+				// the pull of every predator, stronger close by
+				trees[i + 1].field(px, py, pz, -1, OPENING_ANGLE, f.hide + (3 * j), far);
+			}
+			if (f.sep != NULL) {
+				// seperation from the short range pull, cohesion from the long
+				trees[i].field(px, py, pz, j, OPENING_ANGLE, near, far);
+				for (int a = 0; a < 3; a++) {
+					f.sep[(3 * j) + a] = near[a];
+					f.coh[(3 * j) + a] = far[a];
+				}
+			}
+		}, 256);
+	}
+}
 
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i++) {
-		float dist = 99999999.9f; // large float
-		int index = 0;
-		for (unsigned int j = 0; j < particles->at(predIndex).getAmnt(); j++) {
-			float myX, myY, myZ, itX, itY, itZ;
-			myX = particles->at(myIndex).getPosX(i);
-			myY = particles->at(myIndex).getPosY(i);
-			myZ = particles->at(myIndex).getPosZ(i);
-			itX = particles->at(predIndex).getPosX(j);
-			itY = particles->at(predIndex).getPosY(j);
-			itZ = particles->at(predIndex).getPosZ(j);
-			float myDist = sqrt(((myX - itX) * (myX - itX)) + ((myY - itY) * (myY - itY)) + ((myZ - itZ) * (myZ - itZ)));
-			if (myDist < dist) {
-                index = j;
-            }
-		}
-		float theta, epsilon, a, b, c, ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = particles->at(predIndex).getPosX(index) - particles->at(myIndex).getPosX(i);
-		ay = particles->at(predIndex).getPosY(index) - particles->at(myIndex).getPosY(i);
-		az = particles->at(predIndex).getPosZ(index) - particles->at(myIndex).getPosZ(i);
-		
-		// 0 E
-		bx = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * cos(0.0f));
-		by = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * sin(0.0f));
-		bz = particles->at(myIndex).getVels(i) * cos(particles->at(myIndex).getRotTheta(i));
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-
-		// 0 T
-		bx = particles->at(myIndex).getVels(i) * (sin(0.0f) * cos(particles->at(myIndex).getRotEpsilon(i)));
-		by = particles->at(myIndex).getVels(i) * (sin(0.0f) * sin(particles->at(myIndex).getRotEpsilon(i)));
-		bz = particles->at(myIndex).getVels(i) * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		t.push_back(-theta);
-		e.push_back(-epsilon);
+#ifndef CARTESIAN
+void CLHandler::steerField(FlockItem& me, const float* field, float sign, float* t, float* e) {
+	for (int j = 0; j < me.getAmnt(); j++) {
+		steerAngles(field[3 * j], field[(3 * j) + 1], field[(3 * j) + 2],
+			me.getVels(j), me.getHeadSinTPtr()[j], me.getHeadZPtr()[j], t[j], e[j]);
+		t[j] *= sign;
+		e[j] *= sign;
 	}
+}
+#endif
 #endif
 
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
+#ifdef CARTESIAN
+// s += w * (x, y, z) / |(x, y, z)|, a zero vector adds nothing
+static void addUnit(float x, float y, float z, float w, float& sx, float& sy, float& sz) {
+	float len = sqrt((x * x) + (y * y) + (z * z));
+	if (len > 0.0f) {
+		w /= len;
+		sx += x * w;
+		sy += y * w;
+		sz += z * w;
+	}
 }
 
-std::vector<floats> CLHandler::hideFromPack(int myIndex, int predIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL	
-	cl::Buffer preyXBuff = queues[3].makeBuffer(&(particles->at(myIndex).getPosX()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	cl::Buffer preyYBuff = queues[3].makeBuffer(&(particles->at(myIndex).getPosY()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	cl::Buffer preyZBuff = queues[3].makeBuffer(&(particles->at(myIndex).getPosZ()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	cl::Buffer preyRotT = queues[3].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	cl::Buffer preyRotE = queues[3].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	cl::Buffer preyVel = queues[3].makeBuffer(&(particles->at(myIndex).getVels()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[3].ROFlags);
-	floats predPos = floats(3);
-	predPos[0] = avePosX[predIndex];
-	predPos[1] = avePosY[predIndex];
-	predPos[2] = avePosZ[predIndex];
-	cl::Buffer predPosBuff = queues[3].makeBuffer(&(predPos[0]), sizeof(float) * 3, queues[3].ROFlags);
-	cl::Buffer preyTBuff = queues[3].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[3].ROFlags);
-	cl::Buffer preyEBuff = queues[3].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[3].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[3], queues[3].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(preyXBuff, preyYBuff, preyZBuff, preyRotT, preyRotE, preyVel, predPosBuff, particles->at(myIndex).getAmnt(), preyTBuff, preyEBuff);
-	queues[3].getQueue().enqueueMapBuffer(preyTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[3].getQueue().enqueueMapBuffer(preyEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
+void CLHandler::steerCartesian(int myIndex) {
+	TRACE_SCOPE("steer cartesian");
+	FlockItem& me = particles->at(myIndex);
+#ifdef LOCAL_FLOCKING
+	grid.build(me.getPosXPtr(), me.getPosYPtr(), me.getPosZPtr(), me.getAmnt(), PERCEPTION_RADIUS);
+#endif
+	// the new headings are only applied once every member has read the old
+	// ones, as the polar turns are
+	const unsigned int size = me.getAmnt();
+	float* newX = arena.alloc<float>(size);
+	float* newY = arena.alloc<float>(size);
+	float* newZ = arena.alloc<float>(size);
+	parallelFor(0, size, [&](unsigned int j) {
+		float px = me.getPosX(j), py = me.getPosY(j), pz = me.getPosZ(j);
+		// start from the current heading so the weights act as turn rates
+		float sx = me.getDirX(j), sy = me.getDirY(j), sz = me.getDirZ(j);
+		if (myIndex != 0) {
+			// hunt the closest particle.
+			FlockItem& prey = particles->at(myIndex - 1);
+			if (prey.getAmnt() > 0) {
+				unsigned int k = proximity[myIndex].getNearestPrey()[j];
+				addUnit(prey.getPosX(k) - px, prey.getPosY(k) - py, prey.getPosZ(k) - pz, HUNT_W, sx, sy, sz);
+			}
+		} else if (myIndex != (int) particles->size() - 1) {
+			// hide from closest hunter
+			FlockItem& pred = particles->at(myIndex + 1);
+			if (pred.getAmnt() > 0) {
+				unsigned int k = proximity[myIndex + 1].getNearestPred()[j];
+				addUnit(pred.getPosX(k) - px, pred.getPosY(k) - py, pred.getPosZ(k) - pz, -HIDE_FROM_ONE_W, sx, sy, sz);
+			}
+			// hide from all hunters
+#ifdef OCTREE_FIELDS
+			const float* hide = fields[myIndex].hide + (3 * j);
+			addUnit(hide[0], hide[1], hide[2], -HIDE_FROM_ALL_W, sx, sy, sz);
+#else
+			addUnit(avePosX[myIndex + 1] - px, avePosY[myIndex + 1] - py, avePosZ[myIndex + 1] - pz, -HIDE_FROM_ALL_W, sx, sy, sz);
+#endif
+		}
+#ifdef LOCAL_FLOCKING
+		Neighbourhood n;
+		gatherNeighbours(me, j, n);
+		if (n.count > 0) {
+			// alignment
+			addUnit(n.headA, n.headB, n.headC, ALIGN_W, sx, sy, sz);
+			// seperation
+			addUnit(n.awayX, n.awayY, n.awayZ, SEPERATE_W, sx, sy, sz);
+			// cohesion
+			addUnit((n.posX / n.count) - px, (n.posY / n.count) - py, (n.posZ / n.count) - pz, COHESION_W, sx, sy, sz);
+		}
+#else
+		// alignment
+		addUnit(aveDirX[myIndex], aveDirY[myIndex], aveDirZ[myIndex], ALIGN_W, sx, sy, sz);
+#ifdef OCTREE_FIELDS
+		const float* sep = fields[myIndex].sep + (3 * j);
+		const float* coh = fields[myIndex].coh + (3 * j);
+		// seperation
+		addUnit(sep[0], sep[1], sep[2], -SEPERATE_W, sx, sy, sz);
+		// cohesion
+		addUnit(coh[0], coh[1], coh[2], COHESION_W, sx, sy, sz);
+#else
+		// seperation
+		addUnit(avePosX[myIndex] - px, avePosY[myIndex] - py, avePosZ[myIndex] - pz, -SEPERATE_W, sx, sy, sz);
+		// cohesion
+		addUnit(avePosX[myIndex] - px, avePosY[myIndex] - py, avePosZ[myIndex] - pz, COHESION_W, sx, sy, sz);
+#endif
 #endif
-	
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i++) {
-		float theta, epsilon, a, b, c, ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = avePosX[predIndex] - particles->at(myIndex).getPosX(i);
-		ay = avePosX[predIndex] - particles->at(myIndex).getPosY(i);
-		az = avePosX[predIndex] - particles->at(myIndex).getPosZ(i);
-		
-		// 0 E
-		bx = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * cos(0.0f));
-		by = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * sin(0.0f));
-		bz = particles->at(myIndex).getVels(i) * cos(particles->at(myIndex).getRotTheta(i));
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
 
-		// 0 T
-		bx = particles->at(myIndex).getVels(i) * (sin(0.0f) * cos(particles->at(myIndex).getRotEpsilon(i)));
-		by = particles->at(myIndex).getVels(i) * (sin(0.0f) * sin(particles->at(myIndex).getRotEpsilon(i)));
-		bz = particles->at(myIndex).getVels(i) * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		t.push_back(-theta);
-		e.push_back(-epsilon);
+		float len = sqrt((sx * sx) + (sy * sy) + (sz * sz));
+		if (len > 0.0f) {
+			newX[j] = sx / len;
+			newY[j] = sy / len;
+			newZ[j] = sz / len;
+		} else {
+			newX[j] = me.getDirX(j);
+			newY[j] = me.getDirY(j);
+			newZ[j] = me.getDirZ(j);
+		}
+	}, 256);
+	// setDir keeps the flock's running totals, so one member at a time
+	for (unsigned int j = 0; j < size; j++) {
+		me.setDir(newX[j], newY[j], newZ[j], j);
 	}
-#endif
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
 }
+#endif
 
-std::vector<floats> CLHandler::alignment(int myIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL
-	cl::Buffer myRotT = queues[4].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[4].ROFlags);
-	cl::Buffer myRotE = queues[4].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[4].ROFlags);
-	floats aveRots;
-	aveRots.push_back(aveRotT[myIndex]);
-	aveRots.push_back(aveRotE[myIndex]);
-	cl::Buffer aveRotsBuff = queues[4].makeBuffer(&(aveRots[0]), sizeof(float) * 2, queues[4].ROFlags);
-	cl::Buffer retTBuff = queues[4].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[4].ROFlags);
-	cl::Buffer retEBuff = queues[4].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[4].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[4], queues[4].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(myRotT, myRotE, aveRotsBuff, particles->at(myIndex).getAmnt(), retTBuff, retEBuff);
-	queues[4].getQueue().enqueueMapBuffer(retTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[4].getQueue().enqueueMapBuffer(retEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
+#ifdef LOCAL_FLOCKING
+void CLHandler::gatherNeighbours(FlockItem& me, unsigned int index, Neighbourhood& n) {
+	const float* x = me.getPosXPtr();
+	const float* y = me.getPosYPtr();
+	const float* z = me.getPosZPtr();
+	const float px = x[index], py = y[index], pz = z[index];
+	const float r2 = PERCEPTION_RADIUS * PERCEPTION_RADIUS;
+	n.count = 0;
+	n.posX = n.posY = n.posZ = 0.0f;
+	n.awayX = n.awayY = n.awayZ = 0.0f;
+	n.headA = n.headB = n.headC = 0.0f;
+	grid.forEachNear(px, py, pz, [&](unsigned int j) {
+		float dx = px - x[j], dy = py - y[j], dz = pz - z[j];
+		float d2 = (dx * dx) + (dy * dy) + (dz * dz);
+		if (j == index || d2 > r2) {
+			return;
+		}
+		n.count++;
+		n.posX += x[j];
+		n.posY += y[j];
+		n.posZ += z[j];
+		if (d2 > 0.0f) {
+			n.awayX += dx / d2;
+			n.awayY += dy / d2;
+			n.awayZ += dz / d2;
+		}
+#ifdef CARTESIAN
+		n.headA += me.getDirX(j);
+		n.headB += me.getDirY(j);
+		n.headC += me.getDirZ(j);
+#else
+		n.headA += me.getRotTheta(j);
+		n.headB += me.getRotEpsilon(j);
 #endif
+	});
+}
 
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i ++) {
+#ifndef CARTESIAN
+void CLHandler::localFlocking(int myIndex, float* t, float* e) {
+	TRACE_SCOPE("local flocking");
+	FlockItem& me = particles->at(myIndex);
+	grid.build(me.getPosXPtr(), me.getPosYPtr(), me.getPosZPtr(), me.getAmnt(), PERCEPTION_RADIUS);
+	Neighbourhood n;
+	for (int i = 0; i < me.getAmnt(); i++) {
+		t[i] = e[i] = 0.0f;
+		gatherNeighbours(me, i, n);
+		if (n.count == 0) {
+			continue;
+		}
 		float theta, epsilon;
-		theta = aveRotT[myIndex] - particles->at(myIndex).getRotTheta(i);
-		epsilon = aveRotE[myIndex] - particles->at(myIndex).getRotEpsilon(i);
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f
-		t.push_back(theta);
-		e.push_back(epsilon);
+		// alignment
+		theta = fmod((n.headA / n.count) - me.getRotTheta(i), 3.14f);
+		epsilon = fmod((n.headB / n.count) - me.getRotEpsilon(i), (2.0f * 3.14f));
+		t[i] += theta * ALIGN_W;
+		e[i] += epsilon * ALIGN_W;
+		// seperation
+		steerAngles(n.awayX, n.awayY, n.awayZ, me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], theta, epsilon);
+		t[i] += theta * SEPERATE_W;
+		e[i] += epsilon * SEPERATE_W;
+		// cohesion
+		steerAngles((n.posX / n.count) - me.getPosX(i), (n.posY / n.count) - me.getPosY(i), (n.posZ / n.count) - me.getPosZ(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], theta, epsilon);
+		t[i] += theta * COHESION_W;
+		e[i] += epsilon * COHESION_W;
 	}
-#endif
-
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
 }
-
-std::vector<floats> CLHandler::seperation(int myIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL
-	floats avePos;
-	avePos.push_back(avePosX[myIndex]);
-	avePos.push_back(avePosY[myIndex]);
-	avePos.push_back(avePosZ[myIndex]);
-	cl::Buffer posXBuff = queues[5].makeBuffer(&(particles->at(myIndex).getPosX()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags);
-	cl::Buffer posYBuff = queues[5].makeBuffer(&(particles->at(myIndex).getPosY()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags);
-	cl::Buffer posZBuff = queues[5].makeBuffer(&(particles->at(myIndex).getPosZ()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags);
-	cl::Buffer rotTBuff = queues[5].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags); 
-	cl::Buffer rotEBuff = queues[5].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags); 
-	cl::Buffer avePosBuff = queues[5].makeBuffer(&(avePos[0]), sizeof(float), queues[5].ROFlags);
-	cl::Buffer velBuff = queues[5].makeBuffer(&(particles->at(myIndex).getVels()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[5].ROFlags); 
-	cl::Buffer retTBuff = queues[5].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[5].ROFlags);
-	cl::Buffer retEBuff = queues[5].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[5].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[5], queues[5].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(posXBuff, posYBuff, posZBuff, rotTBuff, rotEBuff, avePosBuff, particles->at(myIndex).getAmnt(), velBuff, retTBuff, retEBuff);
-	queues[5].getQueue().enqueueMapBuffer(retTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[5].getQueue().enqueueMapBuffer(retEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
+#endif
 #endif
 
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i++) {
-		float theta, epsilon, a, b, c, ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = avePosX[myIndex] - particles->at(myIndex).getPosX(i);
-		ay = avePosY[myIndex] - particles->at(myIndex).getPosY(i);
-		az = avePosZ[myIndex] - particles->at(myIndex).getPosZ(i);
-		
-		// 0 E
-		bx = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * cos(0.0f));
-		by = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * sin(0.0f));
-		bz = particles->at(myIndex).getVels(i) * cos(particles->at(myIndex).getRotTheta(i));
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		// 0 T
-		bx = particles->at(myIndex).getVels(i) * (sin(0.0f) * cos(particles->at(myIndex).getRotEpsilon(i)));
-		by = particles->at(myIndex).getVels(i) * (sin(0.0f) * sin(particles->at(myIndex).getRotEpsilon(i)));
-		bz = particles->at(myIndex).getVels(i) * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		e.push_back(-epsilon);
-		t.push_back(-theta);
+#ifdef MORTON_REORDER
+void CLHandler::reorderFlocks() {
+	TRACE_SCOPE("morton reorder");
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		FlockItem& f = particles->at(i);
+		f.reorder(morton.sort(f.getPosXPtr(), f.getPosYPtr(), f.getPosZPtr(), f.getAmnt()));
 	}
-#endif
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
 }
-
-std::vector<floats> CLHandler::cohesion(int myIndex) {
-	std::vector<floats> ret;
-	floats t = floats(particles->at(myIndex).getAmnt(), 0.0f), e = floats(particles->at(myIndex).getAmnt(), 0.0f);
-#ifdef OPENCL
-	floats avePos;
-	avePos.push_back(avePosX[myIndex]);
-	avePos.push_back(avePosY[myIndex]);
-	avePos.push_back(avePosZ[myIndex]);
-	cl::Buffer posXBuff = queues[6].makeBuffer(&(particles->at(myIndex).getPosX()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags);
-	cl::Buffer posYBuff = queues[6].makeBuffer(&(particles->at(myIndex).getPosY()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags);
-	cl::Buffer posZBuff = queues[6].makeBuffer(&(particles->at(myIndex).getPosZ()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags);
-	cl::Buffer rotTBuff = queues[6].makeBuffer(&(particles->at(myIndex).getRotTheta()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags); 
-	cl::Buffer rotEBuff = queues[6].makeBuffer(&(particles->at(myIndex).getRotEpsilon()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags); 
-	cl::Buffer avePosBuff = queues[6].makeBuffer(&(avePos[0]), sizeof(float), queues[6].ROFlags);
-	cl::Buffer velBuff = queues[6].makeBuffer(&(particles->at(myIndex).getVels()[0]), sizeof(float) * particles->at(myIndex).getAmnt(), queues[6].ROFlags); 
-	cl::Buffer retTBuff = queues[6].makeBuffer(&(t[0]), sizeof(float) * t.size(), queues[6].ROFlags);
-	cl::Buffer retEBuff = queues[6].makeBuffer(&(e[0]), sizeof(float) * e.size(), queues[6].ROFlags);
-	cl::NDRange globalRange(particles->at(myIndex).getAmnt());
-	cl::KernelFunctor funct(kernels[6], queues[6].getQueue(), cl::NullRange,
-			globalRange, cl::NullRange);
-	funct(posXBuff, posYBuff, posZBuff, rotTBuff, rotEBuff, avePosBuff, particles->at(myIndex).getAmnt(), velBuff, retTBuff, retEBuff);
-	queues[6].getQueue().enqueueMapBuffer(retTBuff, CL_TRUE, CL_MAP_READ, 0, t.size() * sizeof(float));
-	queues[6].getQueue().enqueueMapBuffer(retEBuff, CL_TRUE, CL_MAP_READ, 0, e.size() * sizeof(float));
 #endif
 
-#ifndef OPENCL
-	for (unsigned int i = 0; i < particles->at(myIndex).getAmnt(); i++) {
-		float theta, epsilon, a, b, c, ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = avePosX[myIndex] - particles->at(myIndex).getPosX(i);
-		ay = avePosY[myIndex] - particles->at(myIndex).getPosY(i);
-		az = avePosZ[myIndex] - particles->at(myIndex).getPosZ(i);
-		
-		// 0 E
-		bx = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * cos(0.0f));
-		by = particles->at(myIndex).getVels(i) * (sin(particles->at(myIndex).getRotTheta(i)) * sin(0.0f));
-		bz = particles->at(myIndex).getVels(i) * cos(particles->at(myIndex).getRotTheta(i));
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		theta = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		// 0 T
-		bx = particles->at(myIndex).getVels(i) * (sin(0.0f) * cos(particles->at(myIndex).getRotEpsilon(i)));
-		by = particles->at(myIndex).getVels(i) * (sin(0.0f) * sin(particles->at(myIndex).getRotEpsilon(i)));
-		bz = particles->at(myIndex).getVels(i) * cos(0.0f);
-		cx = ax - bx;
-		cy = ay - by;
-		cz = az - bz;
-		
-		// c^2 = a^2 + b^2 - 2abcos(alpha)
-		c = sqrt((abs(cx) * abs(cx)) + (abs(cy) * abs(cy)) + (abs(cz) * abs(cz)));
-		b = sqrt((abs(bx) * abs(bx)) + (abs(by) * abs(by)) + (abs(bz) * abs(bz)));
-		a = sqrt((abs(ax) * abs(ax)) + (abs(ay) * abs(ay)) + (abs(az) * abs(az)));
-		epsilon = acos((-((c *c) - (a * a) - (b * b))) / (2.0f * a * b));
-		
-		theta = fmod(theta, 3.14f); // theta % 3.14f;
-		epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
-		e.push_back(epsilon);
-		t.push_back(theta);
+void CLHandler::oneIterationOfFlocking() {
+	TRACE_SCOPE("flocking step");
+	// everything taken from the arena last step is dead by now
+	arena.reset();
+#ifdef MORTON_REORDER
+	if (steps % REORDER_PERIOD == 0) {
+		reorderFlocks();
 	}
 #endif
-	ret.push_back(t);
-	ret.push_back(e);
-	return ret;
-}
-
-void CLHandler::oneIterationOfFlocking() {
+	steps++;
+#ifdef COUNTERS
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		Counters::addParticles(particles->at(i).getAmnt());
+	}
+#endif
+	// eatPrey needs the pass every step, steered or not
+	calcProximity();
+	// headings only change once a flock's turns are applied, after its
+	// behaviors, so the backends can read the cache from any thread. The
+	// statistics calcAverages samples read it too.
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		particles->at(i).cacheHeadings();
+	}
 	calcAverages();
-	floats deltaRotE;
-	floats deltaRotT;
-	std::vector<floats> tmp;
+	// between the steered steps of a lower fidelity, see setFidelity
+	if (steps % steerPeriod != 0) {
+		return;
+	}
+#ifdef OCTREE_FIELDS
+	calcFields();
+#endif
+#ifdef CARTESIAN
+	for (unsigned int i = 0; i < particles->size(); i++) {
+		steerCartesian(i);
+	}
+#else
+	float* deltaRotE;
+	float* deltaRotT;
+	float* tmpT;
+	float* tmpE;
+	// a flock's averages in the layout the backends take them
+#if !defined(OCTREE_FIELDS) || !defined(LOCAL_FLOCKING)
+	float* avePos = arena.alloc<float>(3);
+#endif
+#ifndef LOCAL_FLOCKING
+	float* aveRot = arena.alloc<float>(2);
+#endif
 
 	for (unsigned int i = 0; i < particles->size(); i++) {
-		deltaRotE = floats(particles->at(i).getAmnt(), 0.0f);
-		deltaRotT = floats(particles->at(i).getAmnt(), 0.0f);
-		if (i != 0) {
-			// hunt the closest particle.
-			tmp = hunt(i, i - 1);
-			for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-				deltaRotT[j] += tmp[0][j] * HUNT_W;
-				deltaRotE[j] += tmp[1][j] * HUNT_W;
+		TRACE_SCOPE("steer flock");
+		unsigned int size = particles->at(i).getAmnt();
+		deltaRotE = arena.alloc<float>(size, 0.0f);
+		deltaRotT = arena.alloc<float>(size, 0.0f);
+		// each behavior's output is folded in before the next one runs
+		tmpT = arena.alloc<float>(size, 0.0f);
+		tmpE = arena.alloc<float>(size, 0.0f);
+		bool fused = false;
+#if !defined(LOCAL_FLOCKING) && !defined(OCTREE_FIELDS)
+		// a pipeline backend steers with all its behaviors in one pass, see
+		// Pipeline.h
+		FlockItem& me = particles->at(i);
+		const bool hides = i == 0 && i != particles->size() - 1;
+		float predPos[3], mePos[3] = {avePosX[i], avePosY[i], avePosZ[i]}, meRot[2] = {aveRotT[i], aveRotE[i]};
+		SteerInputs in;
+		in.prey = (i != 0 && particles->at(i - 1).getAmnt() > 0) ? &particles->at(i - 1) : NULL;
+		in.nearestPrey = in.prey != NULL ? proximity[i].getNearestPrey() : NULL;
+		in.pred = (hides && particles->at(i + 1).getAmnt() > 0) ? &particles->at(i + 1) : NULL;
+		in.nearestPred = in.pred != NULL ? proximity[i + 1].getNearestPred() : NULL;
+		in.predPos = NULL;
+		if (hides) {
+			predPos[0] = avePosX[i + 1];
+			predPos[1] = avePosY[i + 1];
+			predPos[2] = avePosZ[i + 1];
+			in.predPos = predPos;
+		}
+		in.avePos = mePos;
+		in.aveRot = meRot;
+		fused = backend->steer(me, in, deltaRotT, deltaRotE);
+#endif
+		if (!fused) {
+			// an empty flock has no closest member, which only happens to a
+			// process's share of a flock, see Domain.h
+			if (i != 0) {
+				// hunt the closest particle.
+				if (particles->at(i - 1).getAmnt() > 0) {
+					backend->hunt(particles->at(i), particles->at(i - 1), proximity[i].getNearestPrey(), tmpT, tmpE);
+					for(unsigned int j = 0; j < size; j++) {
+						deltaRotT[j] += tmpT[j] * HUNT_W;
+						deltaRotE[j] += tmpE[j] * HUNT_W;
+					}
+				}
+			} else if(i != particles->size() - 1) {
+				// hide from closest hunter
+				if (particles->at(i + 1).getAmnt() > 0) {
+					backend->hideFromClosestPackMember(particles->at(i), particles->at(i + 1),
+						proximity[i + 1].getNearestPred(), tmpT, tmpE);
+					for(unsigned int j = 0; j < size; j++) {
+						deltaRotT[j] += tmpT[j] * HIDE_FROM_ONE_W;
+						deltaRotE[j] += tmpE[j] * HIDE_FROM_ONE_W;
+					}
+				}
+				// hide from all hunters
+#ifdef OCTREE_FIELDS
+				steerField(particles->at(i), fields[i].hide, -1.0f, tmpT, tmpE);
+#else
+				avePos[0] = avePosX[i + 1];
+				avePos[1] = avePosY[i + 1];
+				avePos[2] = avePosZ[i + 1];
+				backend->hideFromPack(particles->at(i), avePos, tmpT, tmpE);
+#endif
+				for(unsigned int j = 0; j < size; j++) {
+					deltaRotT[j] += tmpT[j] * HIDE_FROM_ALL_W;
+					deltaRotE[j] += tmpE[j] * HIDE_FROM_ALL_W;
+				}
 			}
-		} else if(i != particles->size() - 1) {
-			// hide from closest hunter
-			tmp = hideFromClosestPackMember(i, i + 1);
-			for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-				deltaRotT[j] += tmp[0][j] * HIDE_FROM_ONE_W;
-				deltaRotE[j] += tmp[1][j] * HIDE_FROM_ONE_W;
+
+#ifdef LOCAL_FLOCKING
+			// alignment, seperation and cohesion with the weights already applied
+			localFlocking(i, tmpT, tmpE);
+			for(unsigned int j = 0; j < size; j++) {
+				deltaRotT[j] += tmpT[j];
+				deltaRotE[j] += tmpE[j];
 			}
-			// hide from all hunters
-			tmp = hideFromPack(i, i + 1);
-			for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-				deltaRotT[j] += tmp[0][j] * HIDE_FROM_ALL_W;
-				deltaRotE[j] += tmp[1][j] * HIDE_FROM_ALL_W;
+#else
+			avePos[0] = avePosX[i];
+			avePos[1] = avePosY[i];
+			avePos[2] = avePosZ[i];
+			aveRot[0] = aveRotT[i];
+			aveRot[1] = aveRotE[i];
+			// alignment
+			backend->alignment(particles->at(i), aveRot, tmpT, tmpE);
+			for(unsigned int j = 0; j < size; j++) {
+				deltaRotT[j] += tmpT[j] * ALIGN_W;
+				deltaRotE[j] += tmpE[j] * ALIGN_W;
 			}
-		}
 
-		// alignment
-		tmp = alignment(i);
-		for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-			deltaRotT[j] += tmp[0][j] * ALIGN_W;
-			deltaRotE[j] += tmp[1][j] * ALIGN_W;
-		}
-
-		// seperation
-		tmp = seperation(i);
-		for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-			deltaRotT[j] += tmp[0][j] * SEPERATE_W;
-			deltaRotE[j] += tmp[1][j] * SEPERATE_W;
-		}
+			// seperation
+#ifdef OCTREE_FIELDS
+			steerField(particles->at(i), fields[i].sep, -1.0f, tmpT, tmpE);
+#else
+			backend->seperation(particles->at(i), avePos, tmpT, tmpE);
+#endif
+			for(unsigned int j = 0; j < size; j++) {
+				deltaRotT[j] += tmpT[j] * SEPERATE_W;
+				deltaRotE[j] += tmpE[j] * SEPERATE_W;
+			}
 
-		// cohesion
-		for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
-			tmp = cohesion(i);
-			deltaRotT[j] += tmp[0][j] * COHESION_W;
-			deltaRotE[j] += tmp[1][j] * COHESION_W;
+			// cohesion
+#ifdef OCTREE_FIELDS
+			steerField(particles->at(i), fields[i].coh, 1.0f, tmpT, tmpE);
+#else
+			backend->cohesion(particles->at(i), avePos, tmpT, tmpE);
+#endif
+			for(unsigned int j = 0; j < size; j++) {
+				deltaRotT[j] += tmpT[j] * COHESION_W;
+				deltaRotE[j] += tmpE[j] * COHESION_W;
+			}
+#endif
 		}
 
-		for(unsigned int j = 0; j < particles->at(i).getAmnt(); j++) {
+		for(unsigned int j = 0; j < size; j++) {
 			deltaRotT[j] = fmod(deltaRotT[j], 3.14f); // deltaRotT % 3.14f;
 			deltaRotE[j] = fmod(deltaRotE[j], (3.14f * 2.0f)); // deltaRotE % (2.0f * 3.14f);
 			particles->at(i).addRotT(deltaRotT[j], j);
 			particles->at(i).addRotE(deltaRotE[j], j);
 		}
 	} // [0, pi] rotTheta, [0, 2pi) rotElpson
+#endif
 }
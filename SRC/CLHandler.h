@@ -1,13 +1,33 @@
 // Copyright 2014 Aaron Baker (bakeraj4)
 
-// #define OPENCL_H
+// Alignment, seperation and cohesion over each particle's neighbours within
+// PERCEPTION_RADIUS instead of over the whole flock.
+// #define LOCAL_FLOCKING
+
+// Sort every flock's particles into Morton order every REORDER_PERIOD steps.
+// #define MORTON_REORDER
+
+// hideFromPack, seperation and cohesion against every particle of the other
+// flock through an octree, see OPENING_ANGLE, instead of against its centroid.
+// With LOCAL_FLOCKING only hideFromPack changes.
+// #define OCTREE_FIELDS
 
 #include "FlockItem.h"
+#include "StepArena.h"
+#include "StepBackend.h"
+#include "ProximityPass.h"
+#include "Analytics.h"
+#ifdef LOCAL_FLOCKING
+#include "NeighbourGrid.h"
+#endif
+#ifdef MORTON_REORDER
+#include "MortonOrder.h"
+#endif
+#ifdef OCTREE_FIELDS
+#include "Octree.h"
+#endif
 #include <vector>
 #include <string>
-#ifdef OPENCL_H
-#include "ClCmdQueue.h"
-#endif
 #pragma once
 
 typedef std::vector<float> floats;
@@ -16,25 +36,97 @@ class CLHandler {
 private:
 	std::vector<FlockItem>* particles;
 	floats avePosX, avePosY, avePosZ, aveRotE, aveRotT;
-#ifdef OPENCL_H
-	std::vector<ClCmdQueue> queues;
-	std::vector<cl::Kernel> kernels;
+	// scratch buffers that only live for one oneIterationOfFlocking
+	StepArena arena;
+	// computes the steering behaviors, see StepBackend.h
+	BackendPtr backend;
+#ifdef LOCAL_FLOCKING
+	// rebuilt for each flock every step
+	NeighbourGrid grid;
+#endif
+#ifdef CARTESIAN
+	floats aveDirX, aveDirY, aveDirZ;
+#endif
+	unsigned int steps;
+	// see setFidelity
+	unsigned int steerPeriod;
+	float nearestApproximation;
+	// see setGlobalSums
+	const double* globalSums;
+	// proximity[i] is flock i against its prey, flock i - 1, for this step
+	std::vector<ProximityPass> proximity;
+	// sampled from calcAverages every ANALYTICS_PERIOD steps
+	Analytics analytics;
+#ifdef MORTON_REORDER
+	MortonOrder morton;
+	void reorderFlocks();
+#endif
+#ifdef OCTREE_FIELDS
+	// one flock's fields for this step, x, y, z per member out of the arena.
+	// hide is only set for the flock that hides, sep and coh are NULL with
+	// LOCAL_FLOCKING.
+	struct Fields {
+		float* hide;
+		float* sep;
+		float* coh;
+	};
+	std::vector<Octree> trees;
+	std::vector<Fields> fields;
+	void calcFields();
+#ifndef CARTESIAN
+	void steerField(FlockItem& me, const float* field, float sign, float* t, float* e);
+#endif
 #endif
 
 	void resetAverages();
 	void calcAverages();
-	std::vector<floats> hunt(int myIndex, int preyIndex);
-	std::vector<floats> hideFromClosestPackMember(int myIndex, int predIndex);
-	std::vector<floats> hideFromPack(int myIndex, int predIndex);
-	std::vector<floats> alignment(int myIndex);
-	std::vector<floats> seperation(int myIndex);
-	std::vector<floats> cohesion(int myIndex);
+	void calcProximity();
+#ifdef CARTESIAN
+	void steerCartesian(int myIndex);
+#endif
+#ifdef LOCAL_FLOCKING
+	// sums over the neighbours of one particle, see gatherNeighbours
+	struct Neighbourhood {
+		unsigned int count;
+		float posX, posY, posZ;
+		// sum of (me - other) / dist^2
+		float awayX, awayY, awayZ;
+		// theta and epsilon sums, or the direction sums in CARTESIAN
+		float headA, headB, headC;
+	};
+	void gatherNeighbours(FlockItem& me, unsigned int index, Neighbourhood& n);
+	void localFlocking(int myIndex, float* t, float* e);
+#endif
 	
 public:
-	CLHandler() {};
-	CLHandler(std::vector<FlockItem>* flocks, std::vector<std::string>& kerenelFile,
-		std::vector<std::string>& kernelFuncts, std::string mode);
+	CLHandler() : steps(0), steerPeriod(1), nearestApproximation(0.0f), globalSums(NULL) {};
+	// mode names the backend, see makeBackend; throws std::runtime_error
+	CLHandler(std::vector<FlockItem>* flocks, const std::vector<std::string>& kernelFiles,
+		const std::vector<std::string>& kernelFuncts, const std::string& mode);
 	void oneIterationOfFlocking();
+	// Trades accuracy for time, see Deadline.h: the behaviors only run every
+	// steerPeriod steps, the members keep their headings in between, and the
+	// nearest member searches are approximate, see ProximityPass::build.
+	// 1 and 0 are the exact simulation.
+	void setFidelity(unsigned int period, float approximation) {
+		steerPeriod = period > 0 ? period : 1;
+		nearestApproximation = approximation;
+	}
+	// Averages the flocks over sums instead of over their own members: per
+	// flock, FLOCK_SUMS totals (see FlockItem::getSums) and then the member
+	// count. Read by every step until it is set back to NULL.
+	void setGlobalSums(const double* sums) {
+		globalSums = sums;
+	}
+	// the pass for flock predIndex eating flock predIndex - 1, valid until
+	// the flocks move after this step, NULL for the bottom flock
+	const ProximityPass* getProximity(int predIndex) {
+		return (predIndex > 0 && predIndex < (int) proximity.size()) ? &proximity[predIndex] : NULL;
+	}
+	// see StepBackend::report
+	std::string backendReport() {
+		return backend ? backend->report() : "";
+	}
 	
 	floats getAvePosX() {
 		return avePosX;
@@ -0,0 +1,241 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "StepBackend.h"
+#include "Weights.h"
+#include "Log.h"
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+// largest difference in radians two backends may disagree by
+#define CHECK_TOLERANCE 1e-4f
+// reports printed per behavior before going quiet
+#define CHECK_REPORTS 10
+// the six behaviors, steer and the shared nearest member search
+#define CHECKED 8
+
+// Runs every behavior on two backends and reports where their turns differ
+// by more than CHECK_TOLERANCE. The simulation continues on the first one.
+// Selected with CHECK:<first>,<second>, e.g. CHECK:SCALAR,SIMD. When either
+// backend fuses the behaviors in steer, the other one's steer, or its
+// behaviors one at a time with CLHandler's weights, is the reference, so
+// CHECK:SCALAR,PIPELINE checks a pipeline against the single behaviors.
+// The nearest members CLHandler shares are checked against nearestIndex,
+// and the second backend searches for its own in hunt and
+// hideFromClosestPackMember, so its search is checked against the first.
+// The first CHECK_REPORTS mismatches of each go to the log, the totals are
+// in report().
+class CheckBackend : public StepBackend {
+private:
+	BackendPtr first, second;
+	std::vector<float> otherT, otherE, tmpT, tmpE;
+	unsigned int calls[CHECKED], mismatches[CHECKED];
+
+	void compare(int behavior, const char* name, FlockItem& me, float* t, float* e) {
+		calls[behavior]++;
+		float worst = 0.0f;
+		int worstIndex = 0;
+		for (int i = 0; i < me.getAmnt(); i++) {
+			float diff = fabs(t[i] - otherT[i]) > fabs(e[i] - otherE[i]) ?
+				fabs(t[i] - otherT[i]) : fabs(e[i] - otherE[i]);
+			// NaN on either side only matches NaN on the other
+			if (std::isnan(t[i]) != std::isnan(otherT[i]) || std::isnan(e[i]) != std::isnan(otherE[i])) {
+				diff = 3.14f;
+			}
+			if (diff > worst) {
+				worst = diff;
+				worstIndex = i;
+			}
+		}
+		if (worst > CHECK_TOLERANCE && mismatches[behavior]++ < CHECK_REPORTS) {
+			std::stringstream ss;
+			ss << "CHECK " << name << " call " << calls[behavior] << ": "
+				<< first->getName() << " and " << second->getName() << " differ by " << worst
+				<< " at " << me.getPName() << "[" << worstIndex << "] ("
+				<< t[worstIndex] << ", " << e[worstIndex] << ") vs ("
+				<< otherT[worstIndex] << ", " << otherE[worstIndex] << ")";
+			Log::text(Log::CONSOLE, ss.str());
+		}
+	}
+
+	void prepare(FlockItem& me) {
+		otherT.resize(me.getAmnt());
+		otherE.resize(me.getAmnt());
+	}
+
+	// nearest[i] against a search of all of other, a different index at the
+	// same distance is a tie and matches
+	void checkNearest(FlockItem& me, FlockItem& other, const unsigned int* nearest) {
+		if (nearest == NULL || other.getAmnt() == 0) {
+			return;
+		}
+		calls[7]++;
+		const PosView m = me.posView();
+		const PosView o = other.posView();
+		for (int i = 0; i < me.getAmnt(); i++) {
+			const unsigned int k = nearestIndex(o, other.getAmnt(), m.x(i), m.y(i), m.z(i));
+			if (k == nearest[i]) {
+				continue;
+			}
+			float dx = o.x(k) - m.x(i), dy = o.y(k) - m.y(i), dz = o.z(k) - m.z(i);
+			const float best = (dx * dx) + (dy * dy) + (dz * dz);
+			dx = o.x(nearest[i]) - m.x(i);
+			dy = o.y(nearest[i]) - m.y(i);
+			dz = o.z(nearest[i]) - m.z(i);
+			const float found = (dx * dx) + (dy * dy) + (dz * dz);
+			if (found != best) {
+				if (mismatches[7]++ < CHECK_REPORTS) {
+					std::stringstream ss;
+					ss << "CHECK nearest call " << calls[7] << ": " << me.getPName() << "[" << i
+						<< "] was given " << other.getPName() << "[" << nearest[i] << "] at " << sqrt(found)
+						<< " but [" << k << "] is at " << sqrt(best);
+					Log::text(Log::CONSOLE, ss.str());
+				}
+				return;
+			}
+		}
+	}
+
+	// t += w * tmp, e likewise, as CLHandler folds in each behavior
+	void fold(unsigned int n, double w, float* t, float* e) {
+		for (unsigned int i = 0; i < n; i++) {
+			t[i] += tmpT[i] * w;
+			e[i] += tmpE[i] * w;
+		}
+	}
+
+	// b's steer, or when it has none its behaviors one at a time, the same
+	// ones and in the same order as CLHandler runs them
+	void steerWith(StepBackend& b, FlockItem& me, const SteerInputs& in, float* t, float* e) {
+		if (b.steer(me, in, t, e)) {
+			return;
+		}
+		const unsigned int n = me.getAmnt();
+		tmpT.resize(n);
+		tmpE.resize(n);
+		std::fill(t, t + n, 0.0f);
+		std::fill(e, e + n, 0.0f);
+		if (in.prey != NULL) {
+			b.hunt(me, *in.prey, in.nearestPrey, tmpT.data(), tmpE.data());
+			fold(n, HUNT_W, t, e);
+		}
+		if (in.pred != NULL) {
+			b.hideFromClosestPackMember(me, *in.pred, in.nearestPred, tmpT.data(), tmpE.data());
+			fold(n, HIDE_FROM_ONE_W, t, e);
+		}
+		if (in.predPos != NULL) {
+			b.hideFromPack(me, in.predPos, tmpT.data(), tmpE.data());
+			fold(n, HIDE_FROM_ALL_W, t, e);
+		}
+		b.alignment(me, in.aveRot, tmpT.data(), tmpE.data());
+		fold(n, ALIGN_W, t, e);
+		b.seperation(me, in.avePos, tmpT.data(), tmpE.data());
+		fold(n, SEPERATE_W, t, e);
+		b.cohesion(me, in.avePos, tmpT.data(), tmpE.data());
+		fold(n, COHESION_W, t, e);
+	}
+
+public:
+	CheckBackend(BackendPtr a, BackendPtr b) : first(a), second(b) {
+		for (int i = 0; i < CHECKED; i++) {
+			calls[i] = mismatches[i] = 0;
+		}
+	}
+
+	std::string getName() { return "CHECK:" + first->getName() + "," + second->getName(); }
+
+	// the totals per behavior, then the two backends' own reports
+	std::string report() {
+		const char* names[CHECKED] = {"hunt", "hideFromClosestPackMember", "hideFromPack",
+			"alignment", "seperation", "cohesion", "steer", "nearest"};
+		std::stringstream ss;
+		for (int i = 0; i < CHECKED; i++) {
+			ss << (i == 0 ? "" : "\n") << "CHECK " << names[i] << ": " << mismatches[i] << " of "
+				<< calls[i] << " calls out of tolerance";
+		}
+		const std::string a = first->report(), b = second->report();
+		ss << (a.empty() ? "" : "\n") << a << (b.empty() ? "" : "\n") << b;
+		return ss.str();
+	}
+
+	void hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest, float* t, float* e) {
+		prepare(me);
+		checkNearest(me, prey, nearest);
+		first->hunt(me, prey, nearest, t, e);
+		second->hunt(me, prey, NULL, otherT.data(), otherE.data());
+		compare(0, "hunt", me, t, e);
+	}
+
+	void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+			float* t, float* e) {
+		prepare(me);
+		checkNearest(me, pred, nearest);
+		first->hideFromClosestPackMember(me, pred, nearest, t, e);
+		second->hideFromClosestPackMember(me, pred, NULL, otherT.data(), otherE.data());
+		compare(1, "hideFromClosestPackMember", me, t, e);
+	}
+
+	void hideFromPack(FlockItem& me, const float* predPos, float* t, float* e) {
+		prepare(me);
+		first->hideFromPack(me, predPos, t, e);
+		second->hideFromPack(me, predPos, otherT.data(), otherE.data());
+		compare(2, "hideFromPack", me, t, e);
+	}
+
+	void alignment(FlockItem& me, const float* aveRot, float* t, float* e) {
+		prepare(me);
+		first->alignment(me, aveRot, t, e);
+		second->alignment(me, aveRot, otherT.data(), otherE.data());
+		compare(3, "alignment", me, t, e);
+	}
+
+	void seperation(FlockItem& me, const float* avePos, float* t, float* e) {
+		prepare(me);
+		first->seperation(me, avePos, t, e);
+		second->seperation(me, avePos, otherT.data(), otherE.data());
+		compare(4, "seperation", me, t, e);
+	}
+
+	void cohesion(FlockItem& me, const float* avePos, float* t, float* e) {
+		prepare(me);
+		first->cohesion(me, avePos, t, e);
+		second->cohesion(me, avePos, otherT.data(), otherE.data());
+		compare(5, "cohesion", me, t, e);
+	}
+
+	// only when one of the two fuses, otherwise CLHandler calls the
+	// behaviors above and they are checked one by one
+	bool steer(FlockItem& me, const SteerInputs& in, float* t, float* e) {
+		prepare(me);
+		if (!first->steer(me, in, t, e)) {
+			if (!second->steer(me, in, otherT.data(), otherE.data())) {
+				return false;
+			}
+			steerWith(*first, me, in, t, e);
+		} else {
+			steerWith(*second, me, in, otherT.data(), otherE.data());
+		}
+		if (in.prey != NULL) {
+			checkNearest(me, *in.prey, in.nearestPrey);
+		}
+		if (in.pred != NULL) {
+			checkNearest(me, *in.pred, in.nearestPred);
+		}
+		compare(6, "steer", me, t, e);
+		return true;
+	}
+};
+
+static BackendPtr makeCheck(const BackendArgs& args) {
+	std::size_t comma = args.options.find(",");
+	if (comma == std::string::npos) {
+		throw std::runtime_error("CHECK needs two backends, e.g. CHECK:SCALAR,SIMD");
+	}
+	BackendArgs inner = args;
+	inner.options = "";
+	return BackendPtr(new CheckBackend(makeBackend(args.options.substr(0, comma), inner),
+		makeBackend(args.options.substr(comma + 1), inner)));
+}
+
+static BackendRegistrar checkReg("CHECK", makeCheck);
@@ -0,0 +1,81 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Checks that StepArena serves steady state steps without the heap: counts
+// every operator new while two flocks steer on THREADS, eat and move, with the
+// flocks large enough and $PARTICLE_WORKERS high enough that the parallel
+// loops use several workers, after a few steps to warm up, and fails if any
+// step allocated. The steps that sample the statistics format a line for the
+// log, so they are counted on their own.
+//
+// g++ -std=c++11 -O2 -pthread -I.. ArenaCheck.cpp ../FlockItem.cpp ../CLHandler.cpp ../StepArena.cpp
+//     ../NeighbourGrid.cpp ../MortonOrder.cpp ../StepBackend.cpp ../ScalarBackend.cpp ../ProximityPass.cpp
+//     ../Octree.cpp ../Analytics.cpp ../Log.cpp ../Parallel.cpp ../ThreadedBackend.cpp -o ArenaCheck
+//     (add -lrt on older glibc)
+// ./ArenaCheck [members] [steps]
+
+#include "../CLHandler.h"
+#include "../Parallel.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// steps before counting, long enough for the arena to settle on one block
+#define WARM_UP 4
+// workers when $PARTICLE_WORKERS does not say
+#define CHECK_WORKERS "4"
+
+static std::atomic<unsigned long> allocations(0);
+
+void* operator new(std::size_t size) {
+	allocations++;
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	free(p);
+}
+
+int main(int argc, char* argv[]) {
+	// before the first parallel loop reads it
+	setenv("PARTICLE_WORKERS", CHECK_WORKERS, 0);
+	// chunkWorkers gives a loop a worker per 4096 members
+	const int members = argc > 1 ? atoi(argv[1]) : 20000;
+	const int steps = argc > 2 ? atoi(argv[2]) : 20;
+	std::vector<FlockItem> flocks;
+	std::string prey("prey"), pred("pred");
+	flocks.push_back(FlockItem(0, prey, members));
+	flocks.push_back(FlockItem(1, pred, members / 10));
+	CLHandler handler(&flocks, std::vector<std::string>(), std::vector<std::string>(), "THREADS");
+	unsigned long worst = 0, sampling = 0;
+	for (int s = 0; s < WARM_UP + steps; s++) {
+		const unsigned long before = allocations;
+		handler.oneIterationOfFlocking();
+		flocks[1].eatPrey(flocks[0], handler.getProximity(1));
+		flocks[1].move();
+		flocks[0].move();
+		const unsigned long made = allocations - before;
+		if (s < WARM_UP) {
+			continue;
+		}
+		// the handler counts this step as s + 1
+		if ((s + 1) % ANALYTICS_PERIOD == 0) {
+			sampling += made;
+		} else if (made > worst) {
+			worst = made;
+		}
+	}
+	std::cout << steps << " steps of " << members << " and " << members / 10 << " members on "
+		<< chunkWorkers(members) << " of " << numWorkers() << " workers after " << WARM_UP
+		<< " to warm up: at most " << worst << " heap allocations in a step, " << sampling
+		<< " in all the steps that sampled the statistics\n";
+	return worst == 0 ? 0 : 1;
+}
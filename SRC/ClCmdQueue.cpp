@@ -11,6 +11,7 @@
 #include <vector>
 #include <stdexcept>
 #include "ClCmdQueue.h"
+#include "Trace.h"
 
 /// Convenient Read-Only flags (CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR)
 const cl_mem_flags ClCmdQueue::ROFlags = CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR;
@@ -45,7 +46,12 @@ ClCmdQueue::ClCmdQueue(cl_device_type devType, int platform) throw(cl::Error) {
     // Create a context & queue using the device number
     context = cl::Context(deviceList);
     device  = deviceList[0];
+#ifdef TRACE
+    // Command timestamps for the trace, see OpenCLBackend
+    queue   = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+#else
     queue   = cl::CommandQueue(context, device);
+#endif
 }
 
 /*ClCmdQueue::ClCmdQueue(const std::string& devID, int platform)
@@ -76,7 +82,12 @@ ClCmdQueue::ClCmdQueue(const std::string& devID, int platform) throw (cl::Error)
     // Create a context & queue using the device number
     context = cl::Context(deviceList);
     device  = deviceList[0];
+#ifdef TRACE
+    // Command timestamps for the trace, see OpenCLBackend
+    queue   = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+#else
     queue   = cl::CommandQueue(context, device);
+#endif
 }
 
 cl_device_type
@@ -134,6 +145,7 @@ ClCmdQueue::loadKernel(const std::string& path,
 cl::Buffer
 ClCmdQueue::makeBuffer(void *hostPtr, size_t size,
                        cl_mem_flags flags) throw(cl::Error) {
+    TRACE_SCOPE("makeBuffer");
     return cl::Buffer(context, flags, size, hostPtr);
 }
 
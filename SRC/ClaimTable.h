@@ -0,0 +1,58 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <atomic>
+#include <memory>
+#pragma once
+
+// One atomic word per prey that predators race to claim in eatPrey. A claim
+// keeps the lowest id that asked for the prey, so the winner does not depend
+// on which thread got there first. settle() then freezes the winners so the
+// next round of claims skips them.
+class ClaimTable {
+private:
+	// SETTLED is or'ed into a word once its claim is final, NONE is unclaimed
+	static const unsigned int SETTLED = 0x80000000u;
+	static const unsigned int NONE = 0x7FFFFFFFu;
+	std::unique_ptr<std::atomic<unsigned int>[]> words;
+	unsigned int capacity;
+public:
+	ClaimTable() : capacity(0) {}
+	// the words only matter during one eatPrey, so copies start empty
+	ClaimTable(const ClaimTable&) : capacity(0) {}
+	ClaimTable& operator=(const ClaimTable&) { return *this; }
+
+	// n unclaimed words, only allocating when n outgrows every earlier call
+	void reset(unsigned int n) {
+		if (n > capacity) {
+			words.reset(new std::atomic<unsigned int>[n]);
+			capacity = n;
+		}
+		for (unsigned int i = 0; i < n; i++) {
+			words[i].store(NONE, std::memory_order_relaxed);
+		}
+	}
+
+	bool isSettled(unsigned int index) {
+		return (words[index].load(std::memory_order_relaxed) & SETTLED) != 0;
+	}
+
+	// ids must be below NONE; fails only when the word is already settled
+	void claim(unsigned int index, unsigned int id) {
+		unsigned int cur = words[index].load(std::memory_order_relaxed);
+		while ((cur & SETTLED) == 0 && id < cur) {
+			if (words[index].compare_exchange_weak(cur, id, std::memory_order_relaxed)) {
+				return;
+			}
+		}
+	}
+
+	// true if id holds index after every claim of the round is in
+	bool owns(unsigned int index, unsigned int id) {
+		return words[index].load(std::memory_order_relaxed) == id;
+	}
+
+	void settle(unsigned int index) {
+		words[index].store(words[index].load(std::memory_order_relaxed) | SETTLED,
+			std::memory_order_relaxed);
+	}
+};
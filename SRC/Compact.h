@@ -0,0 +1,183 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Store positions as 16 bit fixed point around each flock's own origin and
+// the angles as 16 bit fractions of a turn, half the bytes of the float
+// arrays. The behaviors widen them to float as they read them. Every move
+// rounds the new positions back to 16 bits, which costs more than the bytes
+// save when a step is not waiting on memory.
+// #define COMPACT
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include "OutOfCore.h"
+#ifdef OUT_OF_CORE
+#define Shorts std::vector<int16_t, MappedAllocator<int16_t> >
+#else
+#define Shorts std::vector<int16_t>
+#endif
+#pragma once
+
+#if defined(COMPACT) && defined(CARTESIAN)
+#error COMPACT stores the angles, which CARTESIAN does not have
+#endif
+
+// the finest position step, 2^-12, which holds values within 8 of the origin
+#define FIXED_STEP (1.0f / 4096.0f)
+#define FIXED_MAX 32767
+// room a rebase leaves on each side, as a fraction of the span it covers
+#define FIXED_MARGIN 0.25f
+// angles are kept modulo 4 pi, which covers every range the behaviors keep
+// them in and gives the same heading
+#define ANGLE_RANGE (4.0f * 3.14159265f)
+#define ANGLE_STEP (ANGLE_RANGE / 65536.0f)
+
+// One coordinate of every member as 16 bit fixed point, origin + q * step.
+// Writing a value out of range rebases the array: a new origin and the finest
+// step that holds every value with some margin, which rounds every member
+// again.
+// Parallel writers must fit() what they write first so nothing rebases.
+class FixedVec {
+private:
+	Shorts q;
+	float origin, step;
+	unsigned int rebases;
+
+	int16_t encode(float v) const {
+		float k = floorf(((v - origin) / step) + 0.5f);
+		return (int16_t) (k < -FIXED_MAX ? -FIXED_MAX : (k > FIXED_MAX ? FIXED_MAX : k));
+	}
+	bool fits(float v) const {
+		float k = (v - origin) / step;
+		return k >= -FIXED_MAX && k <= FIXED_MAX;
+	}
+public:
+	class Ref {
+	private:
+		FixedVec& v;
+		std::size_t i;
+	public:
+		Ref(FixedVec& vec, std::size_t index) : v(vec), i(index) {}
+		operator float() const { return v.origin + (v.q[i] * v.step); }
+		Ref& operator=(float value) {
+			if (!v.fits(value)) {
+				v.fit(value, value);
+			}
+			v.q[i] = v.encode(value);
+			return *this;
+		}
+		Ref& operator=(const Ref& other) { return *this = (float) other; }
+		Ref& operator+=(float d) { return *this = (float) *this + d; }
+	};
+
+	FixedVec() : origin(0.0f), step(FIXED_STEP), rebases(0) {}
+	explicit FixedVec(std::size_t n) : q(n, 0), origin(0.0f), step(FIXED_STEP), rebases(0) {}
+
+	float operator[](std::size_t i) const { return origin + (q[i] * step); }
+	Ref operator[](std::size_t i) { return Ref(*this, i); }
+
+	// makes [lo, hi] representable along with every value already stored
+	void fit(float lo, float hi) {
+		if (fits(lo) && fits(hi)) {
+			return;
+		}
+		float min = lo, max = hi;
+		for (std::size_t i = 0; i < q.size(); i++) {
+			float v = (*this)[i];
+			min = v < min ? v : min;
+			max = v > max ? v : max;
+		}
+		const float span = (max - min) * (1.0f + (2.0f * FIXED_MARGIN));
+		const float newStep = span / (2.0f * FIXED_MAX) > FIXED_STEP ? span / (2.0f * FIXED_MAX) : FIXED_STEP;
+		const float newOrigin = (min + max) / 2.0f;
+		for (std::size_t i = 0; i < q.size(); i++) {
+			float v = (*this)[i];
+			float k = floorf(((v - newOrigin) / newStep) + 0.5f);
+			q[i] = (int16_t) (k < -FIXED_MAX ? -FIXED_MAX : (k > FIXED_MAX ? FIXED_MAX : k));
+		}
+		origin = newOrigin;
+		step = newStep;
+		rebases++;
+	}
+
+	std::size_t size() const { return q.size(); }
+	void resize(std::size_t n) { q.resize(n, encode(origin)); }
+	Shorts::iterator begin() { return q.begin(); }
+	void erase(Shorts::iterator at) { q.erase(at); }
+	const int16_t* data() const { return q.data(); }
+	// the stored values, which keep this array's origin and step
+	Shorts& raw() { return q; }
+	float getOrigin() const { return origin; }
+	float getStep() const { return step; }
+	unsigned int getRebases() const { return rebases; }
+};
+
+// One angle of every member in 16 bits, modulo ANGLE_RANGE, read back in
+// [-ANGLE_RANGE / 2, ANGLE_RANGE / 2).
+class AngleVec {
+private:
+	Shorts q;
+
+	static int16_t encode(float a) {
+		long k = (long) floorf((a / ANGLE_STEP) + 0.5f);
+		return (int16_t) (uint16_t) (k & 0xFFFF);
+	}
+public:
+	class Ref {
+	private:
+		AngleVec& v;
+		std::size_t i;
+	public:
+		Ref(AngleVec& vec, std::size_t index) : v(vec), i(index) {}
+		operator float() const { return v.q[i] * ANGLE_STEP; }
+		Ref& operator=(float a) {
+			v.q[i] = encode(a);
+			return *this;
+		}
+		Ref& operator=(const Ref& other) { return *this = (float) other; }
+		Ref& operator+=(float d) { return *this = (float) *this + d; }
+	};
+
+	AngleVec() {}
+	explicit AngleVec(std::size_t n) : q(n, 0) {}
+
+	float operator[](std::size_t i) const { return q[i] * ANGLE_STEP; }
+	Ref operator[](std::size_t i) { return Ref(*this, i); }
+
+	std::size_t size() const { return q.size(); }
+	void resize(std::size_t n) { q.resize(n, 0); }
+	Shorts::iterator begin() { return q.begin(); }
+	void erase(Shorts::iterator at) { q.erase(at); }
+	const int16_t* data() const { return q.data(); }
+	Shorts& raw() { return q; }
+};
+
+// Positions for the per member loops, read from whichever storage FlockItem
+// has. With COMPACT each read widens a 16 bit value in a register.
+struct PosView {
+#ifdef COMPACT
+	const int16_t *qx, *qy, *qz;
+	float ox, oy, oz, sx, sy, sz;
+	float x(unsigned int i) const { return ox + (qx[i] * sx); }
+	float y(unsigned int i) const { return oy + (qy[i] * sy); }
+	float z(unsigned int i) const { return oz + (qz[i] * sz); }
+#else
+	const float *px, *py, *pz;
+	float x(unsigned int i) const { return px[i]; }
+	float y(unsigned int i) const { return py[i]; }
+	float z(unsigned int i) const { return pz[i]; }
+#endif
+};
+
+// Angles for the per member loops, as PosView for the positions.
+struct AngleView {
+#ifdef COMPACT
+	const int16_t *qt, *qe;
+	float t(unsigned int i) const { return qt[i] * ANGLE_STEP; }
+	float e(unsigned int i) const { return qe[i] * ANGLE_STEP; }
+#else
+	const float *pt, *pe;
+	float t(unsigned int i) const { return pt[i]; }
+	float e(unsigned int i) const { return pe[i]; }
+#endif
+};
@@ -0,0 +1,274 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Counters.h"
+
+#ifdef COUNTERS
+#include "Parallel.h"
+#include "Log.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#define CYCLES 0
+#define INSTRUCTIONS 1
+#define L1D_MISSES 2
+#define LLC_MISSES 3
+#define BRANCH_MISSES 4
+
+namespace {
+
+const char* const EVENT_NAMES[COUNTER_EVENTS] = {"cycles", "instructions", "L1D misses",
+	"LLC misses", "branch misses"};
+
+struct Totals {
+	unsigned long long calls, ns;
+	unsigned long long values[COUNTER_EVENTS];
+	Totals() : calls(0), ns(0) {
+		memset(values, 0, sizeof(values));
+	}
+	void add(const Totals& o) {
+		calls += o.calls;
+		ns += o.ns;
+		for (int i = 0; i < COUNTER_EVENTS; i++) {
+			values[i] += o.values[i];
+		}
+	}
+};
+
+// phase and worker, see workerIndex
+typedef std::pair<std::string, unsigned int> Key;
+
+std::atomic<bool> active(false);
+std::atomic<unsigned long long> particles(0);
+std::chrono::steady_clock::time_point origin;
+std::string outName;
+// which events opened anywhere, and why the first one that failed did
+std::atomic<unsigned int> openedMask(0);
+std::mutex lock;
+std::string openError;
+std::map<Key, Totals> totals;
+
+// trivially destructible, so still readable after mine is gone at exit
+thread_local bool mineAlive = false;
+
+// the calling thread's counter group and what it counted so far
+struct ThreadCounters {
+	// -2 before the first try, -1 if no event could be opened
+	int leader;
+	int fds[COUNTER_EVENTS];
+	// where each event is in a group read, -1 if it is not in the group
+	int slot[COUNTER_EVENTS];
+	unsigned int opened;
+	std::map<const char*, Totals> phases;
+	unsigned int worker;
+
+	ThreadCounters() : leader(-2), opened(0), worker(0) {
+		mineAlive = true;
+		for (int i = 0; i < COUNTER_EVENTS; i++) {
+			fds[i] = -1;
+			slot[i] = -1;
+		}
+	}
+
+	~ThreadCounters() {
+		mineAlive = false;
+		flush();
+		for (int i = 0; i < COUNTER_EVENTS; i++) {
+			if (fds[i] >= 0) {
+				close(fds[i]);
+			}
+		}
+	}
+
+	void flush() {
+		if (phases.empty()) {
+			return;
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		for (std::map<const char*, Totals>::iterator it = phases.begin(); it != phases.end(); ++it) {
+			totals[Key(it->first, worker)].add(it->second);
+		}
+		phases.clear();
+	}
+
+	void open() {
+		static const unsigned int types[COUNTER_EVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+		static const unsigned long long configs[COUNTER_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+		leader = -1;
+		int next = 0;
+		for (int i = 0; i < COUNTER_EVENTS; i++) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			// user space of this thread only, which the default paranoid
+			// level allows
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+				| PERF_FORMAT_TOTAL_TIME_RUNNING;
+			int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+			if (fd < 0) {
+				std::lock_guard<std::mutex> guard(lock);
+				if (openError.empty()) {
+					openError = std::string(EVENT_NAMES[i]) + ": " + strerror(errno);
+				}
+				continue;
+			}
+			if (leader < 0) {
+				leader = fd;
+			}
+			fds[i] = fd;
+			slot[i] = next++;
+			opened |= 1u << i;
+		}
+		openedMask.fetch_or(opened);
+	}
+
+	void read(Counters::Sample& s) {
+		if (leader == -2) {
+			open();
+		}
+		memset(s.values, 0, sizeof(s.values));
+		if (leader < 0) {
+			return;
+		}
+		// nr, time enabled, time running, then one value per event
+		unsigned long long buf[3 + COUNTER_EVENTS];
+		if (::read(leader, buf, sizeof(buf)) <= 0) {
+			return;
+		}
+		// scaled up if the group only got part of the time on the PMU
+		double scale = buf[2] == 0 ? 0.0 : (double) buf[1] / (double) buf[2];
+		for (int i = 0; i < COUNTER_EVENTS; i++) {
+			if (slot[i] >= 0) {
+				s.values[i] = (unsigned long long) (buf[3 + slot[i]] * scale);
+			}
+		}
+	}
+};
+thread_local ThreadCounters mine;
+
+// the pool's threads never exit, so their counts are handed over from here
+void flushWorker(void*, unsigned int) {
+	if (mineAlive) {
+		mine.flush();
+	}
+}
+
+unsigned long long nowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - origin).count();
+}
+
+std::string perParticle(unsigned long long v, unsigned long long n) {
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(3) << (n == 0 ? 0.0 : (double) v / (double) n);
+	return ss.str();
+}
+
+}  // namespace
+
+void Counters::start(const std::string& fileName) {
+	if (active.exchange(true)) {
+		return;
+	}
+	outName = fileName;
+	origin = std::chrono::steady_clock::now();
+	atexit(Counters::report);
+}
+
+void Counters::addParticles(unsigned long long n) {
+	particles.fetch_add(n, std::memory_order_relaxed);
+}
+
+void Counters::read(Sample& s) {
+	if (!active.load(std::memory_order_relaxed)) {
+		return;
+	}
+	mine.read(s);
+	// last, so the clock read is not counted
+	s.ns = nowNs();
+}
+
+void Counters::add(const char* phase, const Sample& begin) {
+	if (!active.load(std::memory_order_relaxed)) {
+		return;
+	}
+	Sample end;
+	end.ns = nowNs();
+	mine.read(end);
+	mine.worker = workerIndex();
+	Totals& t = mine.phases[phase];
+	t.calls++;
+	t.ns += end.ns - begin.ns;
+	// the scaling can make a multiplexed count go backwards, that adds nothing
+	for (int i = 0; i < COUNTER_EVENTS; i++) {
+		t.values[i] += end.values[i] > begin.values[i] ? end.values[i] - begin.values[i] : 0;
+	}
+}
+
+void Counters::report() {
+	if (!active.exchange(false)) {
+		return;
+	}
+	WorkerPool& pool = WorkerPool::get();
+	pool.run(flushWorker, NULL, pool.size());
+	std::ostringstream out;
+	unsigned int have = openedMask.load();
+	unsigned long long n = particles.load();
+	out << "Phase counters over " << n << " particle steps, per worker; phases include the"
+		<< " phases nested in them\n";
+	if (have != (1u << COUNTER_EVENTS) - 1) {
+		out << "Some hardware counters were not available (" << openError
+			<< "), see /proc/sys/kernel/perf_event_paranoid\n";
+	}
+	out << std::left << std::setw(20) << "phase" << std::right << std::setw(7) << "worker"
+		<< std::setw(9) << "calls" << std::setw(12) << "ms";
+	if ((have & (1u << CYCLES)) && (have & (1u << INSTRUCTIONS))) {
+		out << std::setw(8) << "IPC";
+	}
+	for (int i = L1D_MISSES; i < COUNTER_EVENTS; i++) {
+		if (have & (1u << i)) {
+			out << std::setw(20) << (std::string(EVENT_NAMES[i]) + "/particle");
+		}
+	}
+	out << "\n";
+	std::lock_guard<std::mutex> guard(lock);
+	for (std::map<Key, Totals>::iterator it = totals.begin(); it != totals.end(); ++it) {
+		const Totals& t = it->second;
+		out << std::left << std::setw(20) << it->first.first << std::right << std::setw(7)
+			<< it->first.second << std::setw(9) << t.calls << std::setw(12) << std::fixed
+			<< std::setprecision(3) << (t.ns / 1e6);
+		if ((have & (1u << CYCLES)) && (have & (1u << INSTRUCTIONS))) {
+			out << std::setw(8) << std::setprecision(2)
+				<< (t.values[CYCLES] == 0 ? 0.0 : (double) t.values[INSTRUCTIONS] / t.values[CYCLES]);
+		}
+		for (int i = L1D_MISSES; i < COUNTER_EVENTS; i++) {
+			if (have & (1u << i)) {
+				out << std::setw(20) << perParticle(t.values[i], n);
+			}
+		}
+		out << "\n";
+	}
+	totals.clear();
+	Log::text(Log::CONSOLE, out.str());
+	std::ofstream file(outName.c_str());
+	file << out.str();
+}
+#endif
@@ -0,0 +1,59 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Count cycles, instructions, L1 data and last level cache misses and branch
+// misses in every TRACE_SCOPE phase, per worker, through Linux
+// perf_event_open. The report is written to the console and a file when the
+// run ends.
+// #define COUNTERS
+
+#include <string>
+#pragma once
+
+#ifdef COUNTERS
+#define COUNTER_EVENTS 5
+
+// One group of counters per thread, opened the first time the thread enters
+// a phase, so the WorkerPool's threads open theirs once. Each phase costs two
+// reads. A phase's counts
+// include the phases nested in it. Events the kernel does not allow (see
+// /proc/sys/kernel/perf_event_paranoid) or the CPU does not have are left
+// out of the report, and with none at all it only has the phase timings.
+class Counters {
+public:
+	// what a phase reads when it starts and ends
+	struct Sample {
+		unsigned long long ns;
+		unsigned long long values[COUNTER_EVENTS];
+	};
+
+	// starts counting, the report goes to fileName on report()
+	static void start(const std::string& fileName);
+	// stops counting and writes the report. Call it with no parallel loop
+	// running, it also runs at exit.
+	static void report();
+	// particles one step worked on, what the per particle columns divide by
+	static void addParticles(unsigned long long n);
+	static void read(Sample& s);
+	// adds what the calling thread counted between begin and now to phase
+	static void add(const char* phase, const Sample& begin);
+};
+
+class CounterScope {
+private:
+	const char* name;
+	Counters::Sample begin;
+public:
+	explicit CounterScope(const char* phase) : name(phase) {
+		Counters::read(begin);
+	}
+	~CounterScope() {
+		Counters::add(name, begin);
+	}
+};
+
+#define COUNTER_CONCAT_(a, b) a##b
+#define COUNTER_CONCAT(a, b) COUNTER_CONCAT_(a, b)
+#define COUNTER_SCOPE(name) CounterScope COUNTER_CONCAT(counterScope, __LINE__)(name)
+#else
+#define COUNTER_SCOPE(name) (void) 0
+#endif
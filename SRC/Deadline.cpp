@@ -0,0 +1,67 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Deadline.h"
+#include "Log.h"
+#include <cstdlib>
+#include <sstream>
+
+// cheapest last, every level keeps the savings of the ones before it
+static const Fidelity ladder[] = {
+	{1, 1, 0.0f},
+	{2, 1, 0.0f},
+	{2, 2, 0.0f},
+	{2, 2, 0.5f},
+	{4, 4, 0.5f},
+	{8, 8, 1.0f},
+};
+static const unsigned int levels = sizeof(ladder) / sizeof(ladder[0]);
+
+std::string Fidelity::toString() const {
+	std::stringstream ss;
+	ss << "drawing every " << drawStride << ", steering every " << steerPeriod << " steps, ";
+	if (approximation > 0.0f) {
+		ss << "nearest members within " << (1.0f + approximation) << " times";
+	} else {
+		ss << "exact nearest members";
+	}
+	return ss.str();
+}
+
+Deadline::Deadline() : smoothedMs(0.0f), level(0), steps(0), sinceChange(0) {
+	const char* ms = getenv("PARTICLE_DEADLINE_MS");
+	budgetMs = ms != NULL && atof(ms) > 0.0 ? (float) atof(ms) : DEADLINE_MS;
+	stepStart = std::chrono::steady_clock::now();
+}
+
+bool Deadline::endStep() {
+	const float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+	smoothedMs = steps == 0 ? ms : (DEADLINE_SMOOTHING * ms) + ((1.0f - DEADLINE_SMOOTHING) * smoothedMs);
+	steps++;
+	if (++sinceChange < DEADLINE_HOLD) {
+		return false;
+	}
+	if (smoothedMs > budgetMs && level + 1 < levels) {
+		return setLevel(level + 1);
+	} else if (smoothedMs < budgetMs * DEADLINE_SLACK && level > 0) {
+		return setLevel(level - 1);
+	}
+	return false;
+}
+
+bool Deadline::setLevel(unsigned int newLevel) {
+	newLevel = newLevel < levels ? newLevel : levels - 1;
+	if (newLevel == level) {
+		return false;
+	}
+	std::stringstream ss;
+	ss << "Step " << steps << " averaged " << smoothedMs << " ms against " << budgetMs
+		<< " ms, fidelity level " << level << " -> " << newLevel << ": " << ladder[newLevel].toString();
+	Log::text(Log::CONSOLE, ss.str());
+	level = newLevel;
+	sinceChange = 0;
+	return true;
+}
+
+const Fidelity& Deadline::getFidelity() const {
+	return ladder[level];
+}
@@ -0,0 +1,56 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Hold every step, drawing included, to a wall clock budget of DEADLINE_MS,
+// or $PARTICLE_DEADLINE_MS, by trading fidelity for time, see Deadline.
+// #define DEADLINE
+
+#include <chrono>
+#include <string>
+#pragma once
+
+// the step budget for a 60 Hz display
+#define DEADLINE_MS 16.0f
+// weight of the newest step in the smoothed step time
+#define DEADLINE_SMOOTHING 0.2f
+// steps a level is kept before it may change again
+#define DEADLINE_HOLD 8
+// a level is given back once the smoothed step time is under this share of
+// the budget
+#define DEADLINE_SLACK 0.6f
+
+// What a step does at one level of fidelity.
+struct Fidelity {
+	// members drawn, every drawStride-th
+	unsigned int drawStride;
+	// steps between two runs of the behaviors, see CLHandler::setFidelity
+	unsigned int steerPeriod;
+	// the nearest member searches may return one up to 1 + approximation
+	// times farther than the nearest, see ProximityPass::build
+	float approximation;
+
+	std::string toString() const;
+};
+
+// Measures each step's wall time and moves between the levels of a fixed
+// ladder, each cheaper than the last: drawing fewer members, steering less
+// often and approximate nearest member searches. It goes down a level when
+// the smoothed step time is over budget and back up when it is well under,
+// at most once every DEADLINE_HOLD steps, and logs every change.
+class Deadline {
+private:
+	float budgetMs;
+	float smoothedMs;
+	unsigned int level;
+	unsigned int steps, sinceChange;
+	std::chrono::steady_clock::time_point stepStart;
+public:
+	Deadline();
+	// call at the start of every step
+	void startStep() { stepStart = std::chrono::steady_clock::now(); }
+	// call at the end of every step, true if the fidelity changed
+	bool endStep();
+	// moves to level, which the first process picked in a distributed run
+	bool setLevel(unsigned int newLevel);
+	unsigned int getLevel() const { return level; }
+	const Fidelity& getFidelity() const;
+};
@@ -0,0 +1,195 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Domain.h"
+
+#ifdef DISTRIBUTED
+#include "Parallel.h"
+#include <algorithm>
+
+Domain::Domain() {
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+	MPI_Type_contiguous(sizeof(MemberState), MPI_BYTE, &memberType);
+	MPI_Type_commit(&memberType);
+	// one slab for everyone until the first balance
+	bounds.assign(ranks + 1, 0.0f);
+	bounds[0] = -99999999.9f; // large float
+	bounds[ranks] = 99999999.9f;
+	sendCounts.resize(ranks);
+	recvCounts.resize(ranks);
+	sendOffsets.resize(ranks);
+	recvOffsets.resize(ranks);
+}
+
+Domain::~Domain() {
+	MPI_Type_free(&memberType);
+}
+
+int Domain::owner(float x) {
+	// the number of inner bounds at or below x
+	return std::upper_bound(bounds.begin() + 1, bounds.end() - 1, x) - (bounds.begin() + 1);
+}
+
+void Domain::balance(std::vector<FlockItem>& flocks) {
+	TRACE_SCOPE("balance slabs");
+	// min x and -max x, so one MPI_MIN finds both
+	float range[2] = {99999999.9f, 99999999.9f};
+	unsigned long long total = 0;
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		const float* x = flocks[f].getPosXPtr();
+		for (unsigned int i = 0; i < flocks[f].getOwned(); i++) {
+			range[0] = x[i] < range[0] ? x[i] : range[0];
+			range[1] = -x[i] < range[1] ? -x[i] : range[1];
+		}
+		total += flocks[f].getOwned();
+	}
+	MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
+	MPI_Allreduce(MPI_IN_PLACE, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	const float lo = range[0], hi = -range[1];
+	if (total == 0 || !(hi > lo)) {
+		// nothing to spread out, every inner bound at one place
+		for (int r = 1; r < ranks; r++) {
+			bounds[r] = total == 0 ? 0.0f : lo;
+		}
+		return;
+	}
+	const float width = (hi - lo) / SLAB_BINS;
+	histogram.assign(SLAB_BINS, 0);
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		const float* x = flocks[f].getPosXPtr();
+		for (unsigned int i = 0; i < flocks[f].getOwned(); i++) {
+			unsigned int bin = (unsigned int) ((x[i] - lo) / width);
+			histogram[bin < SLAB_BINS ? bin : SLAB_BINS - 1]++;
+		}
+	}
+	MPI_Allreduce(MPI_IN_PLACE, histogram.data(), SLAB_BINS, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+	// bound r goes after the bin where the running count reaches r / ranks
+	unsigned long long seen = 0;
+	int r = 1;
+	for (unsigned int bin = 0; bin < SLAB_BINS && r < ranks; bin++) {
+		seen += histogram[bin];
+		while (r < ranks && seen * ranks >= total * r) {
+			bounds[r++] = lo + ((bin + 1) * width);
+		}
+	}
+	for (; r < ranks; r++) {
+		bounds[r] = hi;
+	}
+}
+
+void Domain::exchange(std::vector<MemberState>& toLeft, std::vector<MemberState>& toRight) {
+	const int left = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+	const int right = rank + 1 < ranks ? rank + 1 : MPI_PROC_NULL;
+	int sendL = toLeft.size(), sendR = toRight.size(), fromL = 0, fromR = 0;
+	MPI_Sendrecv(&sendR, 1, MPI_INT, right, 0, &fromL, 1, MPI_INT, left, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(&sendL, 1, MPI_INT, left, 1, &fromR, 1, MPI_INT, right, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	recvLeft.resize(fromL);
+	recvRight.resize(fromR);
+	MPI_Sendrecv(toRight.data(), sendR, memberType, right, 2, recvLeft.data(), fromL, memberType, left, 2,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(toLeft.data(), sendL, memberType, left, 3, recvRight.data(), fromR, memberType, right, 3,
+		MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+void Domain::exchangeHalos(std::vector<FlockItem>& flocks) {
+	TRACE_SCOPE("exchange halos");
+	sums.assign(flocks.size() * (FLOCK_SUMS + 1), 0.0);
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		flocks[f].getSums(&sums[f * (FLOCK_SUMS + 1)]);
+		sums[(f * (FLOCK_SUMS + 1)) + FLOCK_SUMS] = flocks[f].getAmnt();
+	}
+	MPI_Allreduce(MPI_IN_PLACE, sums.data(), sums.size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+	const float lo = bounds[rank] + HALO_WIDTH, hi = bounds[rank + 1] - HALO_WIDTH;
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		FlockItem& flock = flocks[f];
+		const float* x = flock.getPosXPtr();
+		sendLeft.clear();
+		sendRight.clear();
+		index.clear();
+		if (rank > 0) {
+			for (unsigned int i = 0; i < flock.getOwned(); i++) {
+				if (x[i] < lo) {
+					index.push_back(i);
+				}
+			}
+			flock.exportMembers(index.data(), index.size(), sendLeft);
+		}
+		index.clear();
+		if (rank + 1 < ranks) {
+			for (unsigned int i = 0; i < flock.getOwned(); i++) {
+				if (x[i] >= hi) {
+					index.push_back(i);
+				}
+			}
+			flock.exportMembers(index.data(), index.size(), sendRight);
+		}
+		exchange(sendLeft, sendRight);
+		flock.appendGhosts(recvLeft.data(), recvLeft.size());
+		flock.appendGhosts(recvRight.data(), recvRight.size());
+	}
+}
+
+void Domain::dropHalos(FlockItem& flock) {
+	flock.dropGhosts();
+}
+
+void Domain::migrate(std::vector<FlockItem>& flocks) {
+	balance(flocks);
+	TRACE_SCOPE("migrate");
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		FlockItem& flock = flocks[f];
+		const unsigned int n = flock.getOwned();
+		const float* x = flock.getPosXPtr();
+		dest.resize(n);
+		parallelFor(0, n, [&](unsigned int i) {
+			dest[i] = owner(x[i]);
+		});
+		// the leavers grouped by process, everyone else stays in order
+		std::fill(sendCounts.begin(), sendCounts.end(), 0);
+		keep.clear();
+		for (unsigned int i = 0; i < n; i++) {
+			if ((int) dest[i] == rank) {
+				keep.push_back(i);
+			} else {
+				sendCounts[dest[i]]++;
+			}
+		}
+		sendOffsets[0] = 0;
+		for (int r = 1; r < ranks; r++) {
+			sendOffsets[r] = sendOffsets[r - 1] + sendCounts[r - 1];
+		}
+		index.resize(n - keep.size());
+		std::vector<int> fill(sendOffsets);
+		for (unsigned int i = 0; i < n; i++) {
+			if ((int) dest[i] != rank) {
+				index[fill[dest[i]]++] = i;
+			}
+		}
+		sendAll.clear();
+		flock.exportMembers(index.data(), index.size(), sendAll);
+
+		MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+		recvOffsets[0] = 0;
+		for (int r = 1; r < ranks; r++) {
+			recvOffsets[r] = recvOffsets[r - 1] + recvCounts[r - 1];
+		}
+		recvAll.resize(recvOffsets[ranks - 1] + recvCounts[ranks - 1]);
+		MPI_Alltoallv(sendAll.data(), sendCounts.data(), sendOffsets.data(), memberType,
+			recvAll.data(), recvCounts.data(), recvOffsets.data(), memberType, MPI_COMM_WORLD);
+		if (keep.size() != n) {
+			flock.keepMembers(keep.data(), keep.size());
+		}
+		flock.appendMembers(recvAll.data(), recvAll.size());
+	}
+}
+
+void Domain::sumAll(std::vector<unsigned long long>& v) {
+	MPI_Allreduce(MPI_IN_PLACE, v.data(), v.size(), MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+}
+
+int Domain::fromFirst(int value) {
+	MPI_Bcast(&value, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	return value;
+}
+#endif
@@ -0,0 +1,67 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Run headless over MPI processes (build with mpicxx, run with mpirun -np N),
+// each owning the members of every flock in its slab of space.
+// #define DISTRIBUTED
+
+#ifdef DISTRIBUTED
+#include "FlockItem.h"
+#include <mpi.h>
+#include <vector>
+#pragma once
+
+// resolution of the histogram the slab bounds are placed with
+#define SLAB_BINS 4096
+// how far past its slab a process sees the other processes' members. It
+// covers eatPrey's THRESHHOLD and LOCAL_FLOCKING's PERCEPTION_RADIUS.
+#define HALO_WIDTH THRESHHOLD
+
+// Space is cut into one slab along x per process, placed so the slabs hold
+// about as many members each. A step on every process then goes:
+// exchangeHalos, the usual step on its flocks (CLHandler with
+// setGlobalSums(getSums()), then eatPrey), dropHalos, move, migrate.
+//
+// The ghosts only come from the neighbouring slabs, so slabs thinner than
+// HALO_WIDTH miss some. Closest member searches (hunt,
+// hideFromClosestPackMember) and OCTREE_FIELDS only see a process's own
+// members and its ghosts, and a predator near a slab edge can eat once on
+// each side of it. Everything that uses the flock averages is exact.
+class Domain {
+private:
+	int rank, ranks;
+	MPI_Datatype memberType;
+	// process r owns bounds[r] <= x < bounds[r + 1]
+	std::vector<float> bounds;
+	// per flock the FLOCK_SUMS totals over every process, then the count
+	std::vector<double> sums;
+	std::vector<unsigned long long> histogram;
+	std::vector<MemberState> sendLeft, sendRight, recvLeft, recvRight, sendAll, recvAll;
+	std::vector<unsigned int> index, dest, keep;
+	std::vector<int> sendCounts, recvCounts, sendOffsets, recvOffsets;
+
+	// moves the slab bounds to the members' current positions
+	void balance(std::vector<FlockItem>& flocks);
+	int owner(float x);
+	// swaps one flock's ghosts with both neighbours
+	void exchange(std::vector<MemberState>& toLeft, std::vector<MemberState>& toRight);
+public:
+	// MPI must be initialised
+	Domain();
+	~Domain();
+
+	int getRank() { return rank; }
+	int getRanks() { return ranks; }
+
+	// reduces the flock sums, then adds the ghosts
+	void exchangeHalos(std::vector<FlockItem>& flocks);
+	// valid from exchangeHalos until the next one, see CLHandler::setGlobalSums
+	const double* getSums() { return sums.data(); }
+	void dropHalos(FlockItem& flock);
+	// rebalances the slabs and sends every member to its slab's process
+	void migrate(std::vector<FlockItem>& flocks);
+	// sums v over every process, in place
+	void sumAll(std::vector<unsigned long long>& v);
+	// process 0's value, on every process
+	int fromFirst(int value);
+};
+#endif
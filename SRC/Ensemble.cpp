@@ -0,0 +1,249 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Ensemble.h"
+
+#ifdef ENSEMBLE
+#include "Scenario.h"
+#include "Parallel.h"
+#include "Weights.h"
+#include "Log.h"
+#include "Trace.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// see ensemble.cl
+#define ENSEMBLE_KERNELS "ensemble.cl"
+#define SEG_INTS 4
+#define SEG_FLOATS 5
+// the kernels in the order of their slots in turnT and turnE, the same
+// order as CLHandler folds the behaviors in
+static const char* const KERNEL_NAMES[] = {"huntBatch", "hideFromHunterBatch", "hideFromHuntersBatch",
+	"alignBatch", "seperateBatch", "cohesionBatch"};
+#define BEHAVIORS 6
+
+Ensemble::Ensemble(const std::string& listFile, const std::string& device) : queue(device),
+		launches(0), memberSteps(0) {
+	std::ifstream list(listFile.c_str());
+	if (!list.good()) {
+		throw std::runtime_error("Could not open the ensemble list " + listFile);
+	}
+	std::string line;
+	while (std::getline(list, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		// loaded in place, a copy would be every flock's arrays again
+		sims.push_back(Simulation());
+		Simulation& sim = sims.back();
+		sim.fileName = line;
+		sim.flocks = loadScenario(line);
+		sim.running = true;
+		sim.steps = 0;
+	}
+	if (sims.empty()) {
+		throw std::runtime_error("The ensemble list " + listFile + " names no scenarios");
+	}
+	for (unsigned int k = 0; k < BEHAVIORS; k++) {
+		kernels.push_back(queue.loadKernel(ENSEMBLE_KERNELS, KERNEL_NAMES[k]));
+	}
+}
+
+unsigned int Ensemble::pack() {
+	TRACE_SCOPE("ensemble pack");
+	segFlocks.clear();
+	seg.clear();
+	aves.clear();
+	unsigned int total = 0;
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		if (!sims[s].running) {
+			continue;
+		}
+		std::vector<FlockItem>& flocks = sims[s].flocks;
+		const int first = (int) segFlocks.size();
+		for (unsigned int i = 0; i < flocks.size(); i++) {
+			FlockItem& f = flocks[i];
+			segFlocks.push_back(&f);
+			seg.push_back((int) total);
+			seg.push_back(f.getAmnt());
+			// the same roles as in CLHandler: every flock but the bottom one
+			// hunts the one below, the bottom one hides from the one above
+			seg.push_back(i != 0 ? first + (int) i - 1 : -1);
+			seg.push_back((i == 0 && i != flocks.size() - 1) ? first + 1 : -1);
+			aves.push_back(f.getAvePosX());
+			aves.push_back(f.getAvePosY());
+			aves.push_back(f.getAvePosZ());
+			aves.push_back(f.getAveRotT());
+			aves.push_back(f.getAveRotE());
+			total += f.getAmnt();
+		}
+	}
+	posX.resize(total);
+	posY.resize(total);
+	posZ.resize(total);
+	rotT.resize(total);
+	rotE.resize(total);
+	vels.resize(total);
+	owner.resize(total);
+	turnT.resize(BEHAVIORS * total);
+	turnE.resize(BEHAVIORS * total);
+	// the pointers may be widened copies, made here with their own parallel
+	// loop rather than inside the one below
+	for (unsigned int g = 0; g < segFlocks.size(); g++) {
+		segFlocks[g]->getPosXPtr();
+	}
+	// every flock copies into its own range
+	parallelFor(0, segFlocks.size(), [&](unsigned int g) {
+		FlockItem& f = *segFlocks[g];
+		const unsigned int first = seg[g * SEG_INTS], n = seg[(g * SEG_INTS) + 1];
+		std::copy(f.getPosXPtr(), f.getPosXPtr() + n, posX.begin() + first);
+		std::copy(f.getPosYPtr(), f.getPosYPtr() + n, posY.begin() + first);
+		std::copy(f.getPosZPtr(), f.getPosZPtr() + n, posZ.begin() + first);
+		std::copy(f.getRotThetaPtr(), f.getRotThetaPtr() + n, rotT.begin() + first);
+		std::copy(f.getRotEpsilonPtr(), f.getRotEpsilonPtr() + n, rotE.begin() + first);
+		std::copy(f.getVelsPtr(), f.getVelsPtr() + n, vels.begin() + first);
+		std::fill(owner.begin() + first, owner.begin() + first + n, (int) g);
+	}, 16);
+	return total;
+}
+
+void Ensemble::applyTurns() {
+	TRACE_SCOPE("ensemble turns");
+	const unsigned int total = owner.size();
+	parallelFor(0, segFlocks.size(), [&](unsigned int g) {
+		FlockItem& f = *segFlocks[g];
+		const unsigned int first = seg[g * SEG_INTS], n = seg[(g * SEG_INTS) + 1];
+		for (unsigned int j = 0; j < n; j++) {
+			const unsigned int i = first + j;
+			// a behavior a flock does not have left a 0 turn
+			float dt = 0.0f, de = 0.0f;
+			dt += turnT[i] * HUNT_W;
+			de += turnE[i] * HUNT_W;
+			dt += turnT[total + i] * HIDE_FROM_ONE_W;
+			de += turnE[total + i] * HIDE_FROM_ONE_W;
+			dt += turnT[(2 * total) + i] * HIDE_FROM_ALL_W;
+			de += turnE[(2 * total) + i] * HIDE_FROM_ALL_W;
+			dt += turnT[(3 * total) + i] * ALIGN_W;
+			de += turnE[(3 * total) + i] * ALIGN_W;
+			dt += turnT[(4 * total) + i] * SEPERATE_W;
+			de += turnE[(4 * total) + i] * SEPERATE_W;
+			dt += turnT[(5 * total) + i] * COHESION_W;
+			de += turnE[(5 * total) + i] * COHESION_W;
+			f.addRotT(fmod(dt, 3.14f), j);
+			f.addRotE(fmod(de, (3.14f * 2.0f)), j);
+		}
+	}, 16);
+}
+
+void Ensemble::eatAndMove(Simulation& sim) {
+	std::vector<FlockItem>& flocks = sim.flocks;
+	for (unsigned int i = flocks.size(); i > 0; i--) {
+		if (i != 1) {
+			flocks[i - 1].eatPrey(flocks[i - 2]);
+		}
+		flocks[i - 1].move();
+	}
+	sim.steps++;
+	for (unsigned int i = 0; i < flocks.size(); i++) {
+		if (flocks[i].getAmnt() == 0 || flocks[i].getAmnt() > flocks[i].getThreshold()) {
+			sim.running = false;
+		}
+	}
+}
+
+void Ensemble::step() {
+	TRACE_SCOPE("ensemble step");
+	const unsigned int total = pack();
+	if (total > 0) {
+		TRACE_SCOPE("ensemble kernels");
+		cl::Buffer args[] = {
+			queue.makeBuffer(posX.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(posY.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(posZ.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(rotT.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(rotE.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(vels.data(), sizeof(float) * total, queue.ROFlags),
+			queue.makeBuffer(owner.data(), sizeof(int) * total, queue.ROFlags),
+			queue.makeBuffer(seg.data(), sizeof(int) * seg.size(), queue.ROFlags),
+			queue.makeBuffer(aves.data(), sizeof(float) * aves.size(), queue.ROFlags)
+		};
+		const unsigned int inputs = sizeof(args) / sizeof(args[0]);
+		cl::Buffer tBuff = queue.makeBuffer(turnT.data(), sizeof(float) * turnT.size(), queue.WOFlags);
+		cl::Buffer eBuff = queue.makeBuffer(turnE.data(), sizeof(float) * turnE.size(), queue.WOFlags);
+		// more arguments than cl::KernelFunctor takes, so they are set one by one
+		for (unsigned int k = 0; k < BEHAVIORS; k++) {
+			for (unsigned int a = 0; a < inputs; a++) {
+				kernels[k].setArg(a, args[a]);
+			}
+			kernels[k].setArg(inputs, (int) total);
+			kernels[k].setArg(inputs + 1, (int) k);
+			kernels[k].setArg(inputs + 2, tBuff);
+			kernels[k].setArg(inputs + 3, eBuff);
+			queue.getQueue().enqueueNDRangeKernel(kernels[k], cl::NullRange, cl::NDRange(total), cl::NullRange);
+		}
+		{
+			TRACE_SCOPE("enqueueMapBuffer");
+			queue.getQueue().enqueueMapBuffer(tBuff, CL_TRUE, CL_MAP_READ, 0, sizeof(float) * turnT.size());
+			queue.getQueue().enqueueMapBuffer(eBuff, CL_TRUE, CL_MAP_READ, 0, sizeof(float) * turnE.size());
+		}
+		launches += BEHAVIORS;
+		memberSteps += total;
+		applyTurns();
+	}
+	// one at a time, their own parallel loops already use the workers
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		if (sims[s].running) {
+			eatAndMove(sims[s]);
+		}
+	}
+}
+
+bool Ensemble::running() {
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		if (sims[s].running) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Ensemble::populate() {
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		if (!sims[s].running) {
+			continue;
+		}
+		std::vector<FlockItem>& flocks = sims[s].flocks;
+		for (unsigned int i = 0; i < flocks.size(); i++) {
+			flocks[i].populate(flocks[i].getAvePosX(), flocks[i].getAvePosY(), flocks[i].getAvePosZ());
+		}
+	}
+}
+
+void Ensemble::logGeneration(int number, float minutes) {
+	Log::generation(number, minutes);
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		std::vector<FlockItem>& flocks = sims[s].flocks;
+		for (unsigned int i = 0; i < flocks.size(); i++) {
+			std::stringstream name;
+			name << s << "/" << flocks[i].getPName();
+			Log::flock(name.str(), flocks[i].getAmnt(), flocks[i].getLevel());
+		}
+	}
+	Log::endGeneration();
+}
+
+std::string Ensemble::report() {
+	std::stringstream ss;
+	for (unsigned int s = 0; s < sims.size(); s++) {
+		ss << "Simulation " << s << " (" << sims[s].fileName << ") " << (sims[s].running ? "ran" : "ended after")
+			<< " " << sims[s].steps << " steps:";
+		for (unsigned int i = 0; i < sims[s].flocks.size(); i++) {
+			ss << " " << sims[s].flocks[i].getPName() << " " << sims[s].flocks[i].getAmnt();
+		}
+		ss << "\n";
+	}
+	ss << launches << " kernel launches for " << memberSteps << " member steps over " << sims.size()
+		<< " simulations";
+	return ss.str();
+}
+#endif
@@ -0,0 +1,65 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Run many independent simulations at once instead of one, for parameter
+// sweeps, with every behavior's kernel launched once per step for all of
+// them, see Ensemble. Needs OpenCL, like OPENCL_H in OpenCLBackend.cpp.
+// #define ENSEMBLE
+
+#include "FlockItem.h"
+#include <string>
+#include <vector>
+#pragma once
+
+#ifdef ENSEMBLE
+#if defined(CARTESIAN) || defined(DISTRIBUTED)
+#error ENSEMBLE steers with angles in a single process, it does not go with CARTESIAN or DISTRIBUTED
+#endif
+#include "ClCmdQueue.h"
+
+// The simulations named in a list file, one scenario file per line (see
+// Scenario.h), stepped together on one OpenCL device. A small simulation
+// leaves most of a device idle, so each step packs every running
+// simulation's flocks one after another into shared buffers, with a table of
+// each flock's offset, length, prey and predator, and runs each of the six
+// behaviors in "CL kernels/ensemble.cl" once over all their members. The
+// turns are weighted and applied as CLHandler does, and each simulation
+// then eats and moves on its own. A simulation stops once one of its flocks
+// dies out or outgrows its threshold, the others go on.
+class Ensemble {
+private:
+	struct Simulation {
+		std::string fileName;
+		std::vector<FlockItem> flocks;
+		bool running;
+		unsigned int steps;
+	};
+	std::vector<Simulation> sims;
+	// one queue, so the launches run in order against the same buffers
+	ClCmdQueue queue;
+	std::vector<cl::Kernel> kernels;
+	// this step's packed members, flock tables and turns, see ensemble.cl.
+	// Kept between steps so they only allocate when the ensemble grows.
+	std::vector<float> posX, posY, posZ, rotT, rotE, vels, aves, turnT, turnE;
+	std::vector<int> owner, seg;
+	// the flock each table entry was packed from
+	std::vector<FlockItem*> segFlocks;
+	unsigned long launches, memberSteps;
+
+	unsigned int pack();
+	void applyTurns();
+	// a simulation's flocks, top predator first, as main's moveAllFlocks
+	void eatAndMove(Simulation& sim);
+public:
+	// device is CPU, GPU or ACC. Throws std::runtime_error for a list or
+	// scenario it cannot read and cl::Error when the device or kernels fail.
+	Ensemble(const std::string& listFile, const std::string& device);
+	void step();
+	bool running();
+	// every running simulation's flocks grow around their centroids
+	void populate();
+	// one generation's block in the log, the flocks named simulation/flock
+	void logGeneration(int number, float minutes);
+	// one line per simulation and the launch totals
+	std::string report();
+};
+#endif
@@ -2,98 +2,403 @@
 
 #include <vector>
 #include "FlockItem.h"
+#include "Parallel.h"
+#include "ProximityPass.h"
 #include <stdlib.h>
 #include <math.h>
 #include <iostream>
 
-#define Vec std::vector<float>
+// moves between exact recomputes of the running totals
+#define RESYNC_PERIOD 64
+
+void FlockItem::dropCaches() {
+	headingsValid = false;
+#ifdef COMPACT
+	wideValid = false;
+#endif
+}
+
+#ifdef COMPACT
+// Fits v to the n floats from a on, stride bytes apart. Writes in parallel
+// loops must not rebase, so they fit everything they write first.
+static void fitAll(FixedVec& v, const float* a, unsigned int n, std::size_t stride = sizeof(float)) {
+	if (n == 0) {
+		return;
+	}
+	float lo = a[0], hi = a[0];
+	for (unsigned int k = 1; k < n; k++) {
+		float f = *(const float*) ((const char*) a + (k * stride));
+		lo = f < lo ? f : lo;
+		hi = f > hi ? f : hi;
+	}
+	v.fit(lo, hi);
+}
+#endif
 
 void FlockItem::initVecs(int nMembers) {
-	posX = Vec(nMembers);
-	posY = Vec(nMembers);
-	posZ = Vec(nMembers);
-	rotTheta = Vec(nMembers);
-	rotEpsilon = Vec(nMembers);
+	posX = PosVec(nMembers);
+	posY = PosVec(nMembers);
+	posZ = PosVec(nMembers);
+#ifdef CARTESIAN
+	dirX = Vec(nMembers);
+	dirY = Vec(nMembers);
+	dirZ = Vec(nMembers);
+#else
+	rotTheta = RotVec(nMembers);
+	rotEpsilon = RotVec(nMembers);
+#endif
 	vels = Vec(nMembers);
+	sumX = sumY = sumZ = 0.0;
+#ifdef CARTESIAN
+	sumDirX = sumDirY = sumDirZ = 0.0;
+#else
+	sumT = sumE = 0.0;
+#endif
+	movesSinceResync = 0;
+	dropCaches();
+#ifdef COMPACT
+	roundSq = roundMax = 0.0;
+	rounds = 0;
+#endif
+	ids = Ids(nMembers);
+	parallelFor(0, nMembers, [&](unsigned int i) {
+		ids[i] = i;
+	});
+	nextId = nMembers;
+	idStride = 1;
+	ghostBegin = nMembers;
+	eatenTotal = 0;
+}
+
+void FlockItem::addToSums(unsigned int index, double sign) {
+	sumX += sign * posX[index];
+	sumY += sign * posY[index];
+	sumZ += sign * posZ[index];
+#ifdef CARTESIAN
+	sumDirX += sign * dirX[index];
+	sumDirY += sign * dirY[index];
+	sumDirZ += sign * dirZ[index];
+#else
+	sumT += sign * rotTheta[index];
+	sumE += sign * rotEpsilon[index];
+#endif
+}
+
+void FlockItem::recomputeSums() {
+	sumX = sumY = sumZ = 0.0;
+#ifdef CARTESIAN
+	sumDirX = sumDirY = sumDirZ = 0.0;
+#else
+	sumT = sumE = 0.0;
+#endif
+	for (unsigned int i = 0; i < posX.size(); i++) {
+		addToSums(i, 1.0);
+	}
+	movesSinceResync = 0;
+}
+
+void FlockItem::clearBox() {
+	for (int a = 0; a < 3; a++) {
+		boxMin[a] = 99999999.9f; // large float
+		boxMax[a] = -99999999.9f;
+	}
+}
+
+void FlockItem::growBox(unsigned int index) {
+	boxMin[0] = posX[index] < boxMin[0] ? posX[index] : boxMin[0];
+	boxMin[1] = posY[index] < boxMin[1] ? posY[index] : boxMin[1];
+	boxMin[2] = posZ[index] < boxMin[2] ? posZ[index] : boxMin[2];
+	boxMax[0] = posX[index] > boxMax[0] ? posX[index] : boxMax[0];
+	boxMax[1] = posY[index] > boxMax[1] ? posY[index] : boxMax[1];
+	boxMax[2] = posZ[index] > boxMax[2] ? posZ[index] : boxMax[2];
+}
+
+float FlockItem::boxGap2(FlockItem& other) {
+	float gap2 = 0.0f;
+	for (int a = 0; a < 3; a++) {
+		float gap = other.boxMin[a] - boxMax[a];
+		float back = boxMin[a] - other.boxMax[a];
+		gap = back > gap ? back : gap;
+		if (gap > 0.0f) {
+			gap2 += gap * gap;
+		}
+	}
+	return gap2;
 }
 
-void FlockItem::addSingleParticle(float px, float py, float pz) {
-	posX.push_back(px);
-	posY.push_back(py);
-	posZ.push_back(pz);
-	float r1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	float r2 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	float r3 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	r1 = (r1 * (2 * 3.14f)) - 3.14f;
-	r2 = (r2 * 3.14f) - (3.14f / 2.0f);
-	rotTheta.push_back(r1);
-	rotEpsilon.push_back(r2);
-	vels.push_back((r3 + foodChainLevel) * 0.0000001f);
+void FlockItem::setHeading(float theta, float epsilon, int index) {
+#ifdef CARTESIAN
+	// the only place besides the angle getters that needs trig
+	setDir(sin(theta) * cos(epsilon), sin(theta) * sin(epsilon), cos(theta), index);
+#else
+	setRotTheta(theta, index);
+	setRotEpsilon(epsilon, index);
+#endif
+}
+
+void FlockItem::writeHeading(float theta, float epsilon, unsigned int index) {
+#ifdef CARTESIAN
+	dirX[index] = sin(theta) * cos(epsilon);
+	dirY[index] = sin(theta) * sin(epsilon);
+	dirZ[index] = cos(theta);
+#else
+	rotTheta[index] = theta;
+	rotEpsilon[index] = epsilon;
+#endif
+}
+
+// [0, 1) from a hash of (seed, id, k). Newborns draw their randoms from
+// this instead of rand(), so they can be set up in parallel and still come
+// out the same for any number of threads.
+static float birthRandom(unsigned int seed, unsigned int id, unsigned int k) {
+	unsigned int x = seed ^ (id * 0x9E3779B9u) ^ (k * 0x85EBCA6Bu);
+	x ^= x >> 16;
+	x *= 0x7FEB352Du;
+	x ^= x >> 15;
+	x *= 0x846CA68Bu;
+	x ^= x >> 16;
+	return (x >> 8) * (1.0f / 16777216.0f);
 }
 
 FlockItem::FlockItem(int level, std::string& name, int nMembers) {
 	initVecs(nMembers);
-    // 7 random floats [-x, x] for pos, [0, pi] rotTheta, [0, 2pi) rotElpson, [-2, 2] vel
-	for (int i = 0; i < nMembers; i++) {
-		float r1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-		float r2 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-		float r3 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-	
-		// The range based om the current view point is [-2,2]
-
-		r1 = (r1 * (level + 1.0f)) - ((float) (level + 1.0f) / 2.0f);
-		r2 = (r2 * (level + 1.0f)) - ((float) (level + 1.0f) / 2.0f);
-		r3 = (r3 * (level + 1.0f)) - ((float) (level + 1.0f) / 2.0f);
-	
-		posX[i] = r1;
-		posY[i] = r2;
-		posZ[i] = r3;
-
-		r1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-		r2 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-		r1 = (r1 * (2 * 3.14f));
-		r2 = (r2 * 3.14f);
-	
-		setRotTheta(r1, i);
-		setRotEpsilon(r2, i);
-	
-		r1 = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-		vels[i] = ((r1 + level) * 4.0f) - 2.0f;
-	}
+	// one rand() per flock, the members draw from birthRandom so they can be
+	// set up in parallel
+	const unsigned int seed = rand();
+	// The range based om the current view point is [-2,2]
+	const float span = level + 1.0f;
+#ifdef COMPACT
+	posX.fit(-span / 2.0f, span / 2.0f);
+	posY.fit(-span / 2.0f, span / 2.0f);
+	posZ.fit(-span / 2.0f, span / 2.0f);
+#endif
+	// [-x, x] for pos, [0, 2pi) rotTheta, [0, pi] rotElpson, [-2, 2] vel
+	parallelFor(0, nMembers, [&](unsigned int i) {
+		posX[i] = (birthRandom(seed, i, 0) * span) - (span / 2.0f);
+		posY[i] = (birthRandom(seed, i, 1) * span) - (span / 2.0f);
+		posZ[i] = (birthRandom(seed, i, 2) * span) - (span / 2.0f);
+		writeHeading(birthRandom(seed, i, 3) * (2 * 3.14f), birthRandom(seed, i, 4) * 3.14f, i);
+		vels[i] = ((birthRandom(seed, i, 5) + level) * 4.0f) - 2.0f;
+	});
+	finishInit(level, name, nMembers);
+}
+
+FlockItem::FlockItem(int level, std::string& name, int nMembers, const float* const* state) {
+	initVecs(nMembers);
+#ifdef COMPACT
+	fitAll(posX, state[0], nMembers);
+	fitAll(posY, state[1], nMembers);
+	fitAll(posZ, state[2], nMembers);
+#endif
+	parallelFor(0, nMembers, [&](unsigned int i) {
+		posX[i] = state[0][i];
+		posY[i] = state[1][i];
+		posZ[i] = state[2][i];
+		writeHeading(state[3][i], state[4][i], i);
+		vels[i] = state[5][i];
+	});
+	finishInit(level, name, nMembers);
+}
+
+void FlockItem::finishInit(int level, std::string& name, int nMembers) {
 	amnt = nMembers;
 	threshold = 2 * nMembers;
 	foodChainLevel = level;
 	pName = name;
+	recomputeSums();
+	clearBox();
+	for (int i = 0; i < nMembers; i++) {
+		growBox(i);
+	}
 }
 
 int FlockItem::getThreshold() {
 	return threshold;
 }
 
+#ifdef COMPACT
+void FlockItem::widen() {
+	if (wideValid) {
+		return;
+	}
+	TRACE_SCOPE("widen");
+	const unsigned int n = posX.size();
+	wideX.resize(n);
+	wideY.resize(n);
+	wideZ.resize(n);
+	wideT.resize(n);
+	wideE.resize(n);
+	parallelFor(0, n, [&](unsigned int i) {
+		wideX[i] = posX[i];
+		wideY[i] = posY[i];
+		wideZ[i] = posZ[i];
+		wideT[i] = rotTheta[i];
+		wideE[i] = rotEpsilon[i];
+	});
+	wideValid = true;
+}
+
+void FlockItem::noteRounding(float stored, float exact) {
+	double d = fabs(stored - exact);
+	roundSq += d * d;
+	roundMax = d > roundMax ? d : roundMax;
+	rounds++;
+}
+
+std::string FlockItem::precisionReport() {
+	std::stringstream ss;
+	float step = posX.getStep() > posY.getStep() ? posX.getStep() : posY.getStep();
+	step = posZ.getStep() > step ? posZ.getStep() : step;
+	ss << pName << ": position rounding rms " << (rounds > 0 ? sqrt(roundSq / rounds) : 0.0)
+		<< " max " << roundMax << " over " << rounds << " moves, step " << step << " (finest " << FIXED_STEP
+		<< "), " << (posX.getRebases() + posY.getRebases() + posZ.getRebases()) << " rebases, angle step "
+		<< ANGLE_STEP;
+	return ss.str();
+}
+#endif
+
 Vec FlockItem::getPosX() {
+#ifdef COMPACT
+	widen();
+	return wideX;
+#else
 	return posX;
+#endif
 }
 
 Vec FlockItem::getPosY() {
+#ifdef COMPACT
+	widen();
+	return wideY;
+#else
 	return posY;
+#endif
 }
 
 Vec FlockItem::getPosZ() {
+#ifdef COMPACT
+	widen();
+	return wideZ;
+#else
 	return posZ;
+#endif
 }
 
 Vec FlockItem::getRotTheta() {
+#ifdef CARTESIAN
+	Vec ret(amnt);
+	for (int i = 0; i < amnt; i++) {
+		ret[i] = getRotTheta(i);
+	}
+	return ret;
+#elif defined(COMPACT)
+	widen();
+	return wideT;
+#else
 	return rotTheta;
+#endif
 }
 
 Vec FlockItem::getRotEpsilon() {
+#ifdef CARTESIAN
+	Vec ret(amnt);
+	for (int i = 0; i < amnt; i++) {
+		ret[i] = getRotEpsilon(i);
+	}
+	return ret;
+#elif defined(COMPACT)
+	widen();
+	return wideE;
+#else
 	return rotEpsilon;
+#endif
 }
 
 Vec FlockItem::getVels() {
 	return vels;
 }
 
+float* FlockItem::getPosXPtr() {
+#ifdef COMPACT
+	widen();
+	return wideX.data();
+#else
+	return posX.data();
+#endif
+}
+
+float* FlockItem::getPosYPtr() {
+#ifdef COMPACT
+	widen();
+	return wideY.data();
+#else
+	return posY.data();
+#endif
+}
+
+float* FlockItem::getPosZPtr() {
+#ifdef COMPACT
+	widen();
+	return wideZ.data();
+#else
+	return posZ.data();
+#endif
+}
+
+float* FlockItem::getRotThetaPtr() {
+#ifdef COMPACT
+	widen();
+	return wideT.data();
+#else
+	return rotTheta.data();
+#endif
+}
+
+float* FlockItem::getRotEpsilonPtr() {
+#ifdef COMPACT
+	widen();
+	return wideE.data();
+#else
+	return rotEpsilon.data();
+#endif
+}
+
+float* FlockItem::getVelsPtr() {
+	return vels.data();
+}
+
+PosView FlockItem::posView() {
+	PosView v;
+#ifdef COMPACT
+	v.qx = posX.data();
+	v.qy = posY.data();
+	v.qz = posZ.data();
+	v.ox = posX.getOrigin();
+	v.oy = posY.getOrigin();
+	v.oz = posZ.getOrigin();
+	v.sx = posX.getStep();
+	v.sy = posY.getStep();
+	v.sz = posZ.getStep();
+#else
+	v.px = posX.data();
+	v.py = posY.data();
+	v.pz = posZ.data();
+#endif
+	return v;
+}
+
+AngleView FlockItem::angleView() {
+	AngleView v;
+#ifdef COMPACT
+	v.qt = rotTheta.data();
+	v.qe = rotEpsilon.data();
+#else
+	v.pt = rotTheta.data();
+	v.pe = rotEpsilon.data();
+#endif
+	return v;
+}
+
 float FlockItem::getPosX(int index) {
 	return posX[index];
 }
@@ -107,44 +412,138 @@ float FlockItem::getPosZ(int index) {
 }
 
 float FlockItem::getRotTheta(int index) {
+#ifdef CARTESIAN
+	return acos(dirZ[index]);
+#else
 	return rotTheta[index];
+#endif
 }
 
 float FlockItem::getRotEpsilon(int index) {
+#ifdef CARTESIAN
+	return atan2(dirY[index], dirX[index]);
+#else
 	return rotEpsilon[index];
+#endif
 }
 
 float FlockItem::getVels(int index) {
 	return vels[index];
 }
 
+unsigned int FlockItem::getId(int index) {
+	return ids[index];
+}
+
 void FlockItem::addPosX(float n_x, int index) {
+#ifdef COMPACT
+	// the sum follows the value that was stored, not the one asked for
+	float old = posX[index];
+	posX[index] = old + n_x;
+	noteRounding(posX[index], old + n_x);
+	sumX += posX[index] - old;
+	wideValid = false;
+#else
 	posX[index] += n_x;
+	sumX += n_x;
+#endif
 }
 
 void FlockItem::addPosY(float n_y, int index) {
+#ifdef COMPACT
+	// the sum follows the value that was stored, not the one asked for
+	float old = posY[index];
+	posY[index] = old + n_y;
+	noteRounding(posY[index], old + n_y);
+	sumY += posY[index] - old;
+	wideValid = false;
+#else
 	posY[index] += n_y;
+	sumY += n_y;
+#endif
 }
 
 void FlockItem::addPosZ(float n_z, int index) {
+#ifdef COMPACT
+	// the sum follows the value that was stored, not the one asked for
+	float old = posZ[index];
+	posZ[index] = old + n_z;
+	noteRounding(posZ[index], old + n_z);
+	sumZ += posZ[index] - old;
+	wideValid = false;
+#else
 	posZ[index] += n_z;
+	sumZ += n_z;
+#endif
 }
 
 void FlockItem::addRotT(float n_t, int index) {
-	rotTheta[index] = fmod(rotTheta[index], 3.14f);
+#ifdef CARTESIAN
+	setRotTheta(fmod(getRotTheta(index) + n_t, 3.14f), index);
+#else
+	float old = rotTheta[index];
+	rotTheta[index] = fmod(old + n_t, 3.14f);
+	dropCaches();
+	sumT += rotTheta[index] - old;
+#endif
 }
 
 void FlockItem::addRotE(float n_e, int index) {
-	rotEpsilon[index] = fmod(rotEpsilon[index], (3.14f * 2.0f));
+#ifdef CARTESIAN
+	setRotEpsilon(fmod(getRotEpsilon(index) + n_e, (3.14f * 2.0f)), index);
+#else
+	float old = rotEpsilon[index];
+	rotEpsilon[index] = fmod(old + n_e, (3.14f * 2.0f));
+	dropCaches();
+	sumE += rotEpsilon[index] - old;
+#endif
 }
 
 void FlockItem::setRotTheta(float n_x, int index) {
+#ifdef CARTESIAN
+	setHeading(n_x, getRotEpsilon(index), index);
+#else
+	float old = rotTheta[index];
 	rotTheta[index] = n_x;
+	sumT += rotTheta[index] - old;
+	dropCaches();
+#endif
 }
 
 void FlockItem::setRotEpsilon(float n_y, int index) {
+#ifdef CARTESIAN
+	setHeading(getRotTheta(index), n_y, index);
+#else
+	float old = rotEpsilon[index];
 	rotEpsilon[index] = n_y;
+	sumE += rotEpsilon[index] - old;
+	dropCaches();
+#endif
+}
+
+#ifdef CARTESIAN
+float FlockItem::getDirX(int index) {
+	return dirX[index];
+}
+
+float FlockItem::getDirY(int index) {
+	return dirY[index];
+}
+
+float FlockItem::getDirZ(int index) {
+	return dirZ[index];
+}
+
+void FlockItem::setDir(float x, float y, float z, int index) {
+	sumDirX += x - dirX[index];
+	sumDirY += y - dirY[index];
+	sumDirZ += z - dirZ[index];
+	dirX[index] = x;
+	dirY[index] = y;
+	dirZ[index] = z;
+	dropCaches();
 }
+#endif
 
 int FlockItem::getAmnt() {
 	return amnt;
@@ -159,60 +558,540 @@ std::string FlockItem::getPName() {
 }
 
 void FlockItem::removeParticleI(unsigned int index) {
+	addToSums(index, -1.0);
 	// posX, posY, posZ, rotTheta, rotEpsilon, vels
 	posX.erase(posX.begin() + index);
 	posY.erase(posY.begin() + index);
 	posZ.erase(posZ.begin() + index);
+#ifdef CARTESIAN
+	dirX.erase(dirX.begin() + index);
+	dirY.erase(dirY.begin() + index);
+	dirZ.erase(dirZ.begin() + index);
+#else
 	rotTheta.erase(rotTheta.begin() + index);
 	rotEpsilon.erase(rotEpsilon.begin() + index);
+#endif
+	vels.erase(vels.begin() + index);
+	ids.erase(ids.begin() + index);
+	if (index < ghostBegin) {
+		ghostBegin--;
+	}
+	dropCaches();
 }
 
 void FlockItem::decrementAmnt() {
 	amnt--;
 }
 
+template<typename V>
+static void gatherVec(V& v, V& scratch, const unsigned int* from, unsigned int n) {
+	scratch.resize(n);
+	parallelFor(0, n, [&](unsigned int i) {
+		scratch[i] = v[from[i]];
+	});
+	v.swap(scratch);
+}
+
+#ifdef COMPACT
+// the 16 bit arrays move their stored values, which keeps their scale
+static void gatherVec(FixedVec& v, Shorts& scratch, const unsigned int* from, unsigned int n) {
+	gatherVec(v.raw(), scratch, from, n);
+}
+
+static void gatherVec(AngleVec& v, Shorts& scratch, const unsigned int* from, unsigned int n) {
+	gatherVec(v.raw(), scratch, from, n);
+}
+#endif
+
+void FlockItem::gather(const unsigned int* from, unsigned int n) {
+	gatherVec(posX, posScratch, from, n);
+	gatherVec(posY, posScratch, from, n);
+	gatherVec(posZ, posScratch, from, n);
+#ifdef CARTESIAN
+	gatherVec(dirX, scratch, from, n);
+	gatherVec(dirY, scratch, from, n);
+	gatherVec(dirZ, scratch, from, n);
+#else
+	gatherVec(rotTheta, posScratch, from, n);
+	gatherVec(rotEpsilon, posScratch, from, n);
+#endif
+	gatherVec(vels, scratch, from, n);
+	gatherVec(ids, idScratch, from, n);
+	dropCaches();
+}
+
+void FlockItem::reorder(const unsigned int* perm) {
+	// a permutation leaves the running sums as they are
+	gather(perm, ids.size());
+}
+
+void FlockItem::cacheHeadings() {
+	if (headingsValid) {
+		return;
+	}
+	TRACE_SCOPE("cache headings");
+	headSinT.resize(amnt);
+#ifndef CARTESIAN
+	headX.resize(amnt);
+	headY.resize(amnt);
+	headZ.resize(amnt);
+#endif
+	// the only trig on the headings in a step
+	const StreamArrays s = streamArrays();
+	parallelChunks(0, amnt, [&](unsigned int, unsigned int b, unsigned int e) {
+		streamChunks(b, e, s, [&](unsigned int cb, unsigned int ce) {
+			for (unsigned int i = cb; i < ce; i++) {
+#ifdef CARTESIAN
+				const float hx = dirX[i], hy = dirY[i];
+				// theta is acos(z), in [0, pi], so its sine is never negative
+				headSinT[i] = sqrt((hx * hx) + (hy * hy));
+#else
+				const float theta = rotTheta[i], epsilon = rotEpsilon[i];
+				float sinT = sin(theta);
+				headX[i] = sinT * cos(epsilon);
+				headY[i] = sinT * sin(epsilon);
+				headZ[i] = cos(theta);
+				headSinT[i] = sinT;
+#endif
+			}
+		});
+	});
+	headingsValid = true;
+}
+
+const float* FlockItem::getHeadXPtr() {
+#ifdef CARTESIAN
+	return dirX.data();
+#else
+	return headX.data();
+#endif
+}
+
+const float* FlockItem::getHeadYPtr() {
+#ifdef CARTESIAN
+	return dirY.data();
+#else
+	return headY.data();
+#endif
+}
+
+const float* FlockItem::getHeadZPtr() {
+#ifdef CARTESIAN
+	return dirZ.data();
+#else
+	return headZ.data();
+#endif
+}
+
+const float* FlockItem::getHeadSinTPtr() {
+	return headSinT.data();
+}
+
+StreamArrays FlockItem::streamArrays() {
+	StreamArrays s;
+	s.add(posX.data(), sizeof(*posX.data()));
+	s.add(posY.data(), sizeof(*posY.data()));
+	s.add(posZ.data(), sizeof(*posZ.data()));
+#ifdef CARTESIAN
+	s.add(dirX.data());
+	s.add(dirY.data());
+	s.add(dirZ.data());
+#else
+	s.add(rotTheta.data(), sizeof(*rotTheta.data()));
+	s.add(rotEpsilon.data(), sizeof(*rotEpsilon.data()));
+	s.add(headX.data());
+	s.add(headY.data());
+	s.add(headZ.data());
+#endif
+	s.add(vels.data());
+	s.add(headSinT.data());
+	return s;
+}
+
 void FlockItem::move(unsigned int index) {
 	// x += precentX * vel
 	// y += percentY * vel
-	// z += percentZ * vel
-	// the spherical cordianates of the roation
-	float amntX, amntY, amntZ;
-	amntX = sin(rotTheta[index]) * cos(rotEpsilon[index]);
-	amntY = sin(rotTheta[index]) * sin(rotEpsilon[index]);
-	amntZ = cos(rotTheta[index]);
-	addPosX((amntX * vels[index]), index);
-	addPosY((amntY * vels[index]), index);
-	addPosZ((amntZ * vels[index]), index);
+	// z += percentZ * vel, the product is made here rather than cached so
+	// the cache is four arrays and not seven
+	addPosX(getHeadXPtr()[index] * vels[index], index);
+	addPosY(getHeadYPtr()[index] * vels[index], index);
+	addPosZ(getHeadZPtr()[index] * vels[index], index);
 }
 
 void FlockItem::move() {
-	for (unsigned int i = 0; i < amnt; i++) {
-		move(i);
+	TRACE_SCOPE("move");
+	cacheHeadings();
+	clearBox();
+#ifdef COMPACT
+	const unsigned int rebases = posX.getRebases() + posY.getRebases() + posZ.getRebases();
+#endif
+	streamChunks(0, amnt, streamArrays(), [&](unsigned int b, unsigned int e) {
+		for (unsigned int i = b; i < e; i++) {
+			move(i);
+			growBox(i);
+		}
+	});
+#ifdef COMPACT
+	// a rebase rounded the members that had moved already again
+	if (posX.getRebases() + posY.getRebases() + posZ.getRebases() != rebases) {
+		clearBox();
+		for (int i = 0; i < amnt; i++) {
+			growBox(i);
+		}
+		movesSinceResync = RESYNC_PERIOD;
+	}
+#endif
+	if (++movesSinceResync >= RESYNC_PERIOD) {
+		recomputeSums();
 	}
 }
 
+float FlockItem::getAvePosX() {
+	return amnt == 0 ? 0.0f : (float) (sumX / amnt);
+}
+
+float FlockItem::getAvePosY() {
+	return amnt == 0 ? 0.0f : (float) (sumY / amnt);
+}
+
+float FlockItem::getAvePosZ() {
+	return amnt == 0 ? 0.0f : (float) (sumZ / amnt);
+}
+
+#ifdef CARTESIAN
+float FlockItem::getAveDirX() {
+	return amnt == 0 ? 0.0f : (float) (sumDirX / amnt);
+}
+
+float FlockItem::getAveDirY() {
+	return amnt == 0 ? 0.0f : (float) (sumDirY / amnt);
+}
+
+float FlockItem::getAveDirZ() {
+	return amnt == 0 ? 0.0f : (float) (sumDirZ / amnt);
+}
+#else
+float FlockItem::getAveRotT() {
+	return amnt == 0 ? 0.0f : (float) (sumT / amnt);
+}
+
+float FlockItem::getAveRotE() {
+	return amnt == 0 ? 0.0f : (float) (sumE / amnt);
+}
+#endif
+
 void FlockItem::populate(float ax, float ay, float az) {
-	int num = (int)floor(amnt / 2.0);
-	for (int i = 0; i < num; i++) {
-		addSingleParticle(ax, ay, az);
-	}
-	amnt += num;
-}
-
-static float THRESHHOLD = 0.5f;
-void FlockItem::eatPrey(FlockItem& prey) {
-	for (unsigned int i = 0; i < amnt; i++) {
-		for (unsigned int j = 0; j < prey.getAmnt(); j++) {
-			float dist = sqrt(
-				pow((prey.getPosX()[j] - posX[i]), 2) +
-				pow((prey.getPosY()[j] - posY[i]), 2) +
-				pow((prey.getPosZ()[j] - posZ[i]), 2)
-			);
-			if (dist < THRESHHOLD) {
-				prey.removeParticleI(j);
-				prey.decrementAmnt();
-				break; // so only 1 partilce can be sucessfully hunted at a time
+	TRACE_SCOPE("populate");
+	const unsigned int first = amnt;
+	const unsigned int total = amnt + (amnt / 2);
+	if (total == first) {
+		return;
+	}
+	// one resize per array, the newborns fill the new tail in parallel
+	posX.resize(total);
+	posY.resize(total);
+	posZ.resize(total);
+#ifdef CARTESIAN
+	dirX.resize(total);
+	dirY.resize(total);
+	dirZ.resize(total);
+#else
+	rotTheta.resize(total);
+	rotEpsilon.resize(total);
+#endif
+	vels.resize(total);
+	ids.resize(total);
+#ifdef COMPACT
+	posX.fit(ax, ax);
+	posY.fit(ay, ay);
+	posZ.fit(az, az);
+#endif
+	const unsigned int seed = rand();
+	const unsigned int firstId = nextId;
+	nextId += (total - first) * idStride;
+	parallelFor(first, total, [&](unsigned int i) {
+		unsigned int id = firstId + ((i - first) * idStride);
+		float r1 = birthRandom(seed, id, 0);
+		float r2 = birthRandom(seed, id, 1);
+		float r3 = birthRandom(seed, id, 2);
+		r1 = (r1 * (2 * 3.14f)) - 3.14f;
+		r2 = (r2 * 3.14f) - (3.14f / 2.0f);
+		posX[i] = ax;
+		posY[i] = ay;
+		posZ[i] = az;
+#ifdef CARTESIAN
+		dirX[i] = sin(r1) * cos(r2);
+		dirY[i] = sin(r1) * sin(r2);
+		dirZ[i] = cos(r1);
+#else
+		rotTheta[i] = r1;
+		rotEpsilon[i] = r2;
+#endif
+		vels[i] = (r3 + foodChainLevel) * 0.0000001f;
+		ids[i] = id;
+	});
+	for (unsigned int i = first; i < total; i++) {
+		addToSums(i, 1.0);
+		growBox(i);
+	}
+	amnt = total;
+	ghostBegin = total;
+	dropCaches();
+}
+
+void FlockItem::eatPrey(FlockItem& prey, const ProximityPass* near) {
+	TRACE_SCOPE("eatPrey");
+	const unsigned int n = prey.getAmnt();
+	// the boxes bound every pair's distance from below
+	if (amnt == 0 || n == 0 || boxGap2(prey) >= THRESHHOLD * THRESHHOLD) {
+		return;
+	}
+	// the pass only holds if the prey have not changed since it was built.
+	// This flock may have lost members to its own predators since then, but
+	// that keeps the survivors in order, so their ids find them in the pass.
+	if (near != NULL && near->getPreyCount() == n) {
+		passIndex.resize(amnt);
+		unsigned int p = 0;
+		for (int i = 0; i < amnt && near != NULL; i++) {
+			while (p < near->getPredCount() && near->getPredId(p) != ids[i]) {
+				p++;
+			}
+			if (p == near->getPredCount()) {
+				near = NULL;
+			} else {
+				passIndex[i] = p++;
+			}
+		}
+	} else {
+		near = NULL;
+	}
+	const PosView pv = prey.posView();
+	const float reach = THRESHHOLD * THRESHHOLD;
+	prey.claims.reset(n);
+	hunters.resize(amnt);
+	targets.assign(amnt, 0);
+	for (int i = 0; i < amnt; i++) {
+		hunters[i] = i;
+	}
+	unsigned int pending = amnt;
+	while (pending > 0) {
+		// every hunter claims the first prey in reach that nobody has won yet,
+		// targets[i] is where its scan stopped, in the prey or its candidates
+		parallelFor(0, pending, [&](unsigned int h) {
+			unsigned int i = hunters[h];
+			unsigned int j = targets[i];
+			if (near != NULL) {
+				const unsigned int* list;
+				unsigned int count = near->getCandidates(passIndex[i], list);
+				while (j < count && prey.claims.isSettled(list[j])) {
+					j++;
+				}
+				targets[i] = j;
+				j = j < count ? list[j] : n;
+			} else {
+				for (; j < n; j++) {
+					float dx = pv.x(j) - posX[i], dy = pv.y(j) - posY[i], dz = pv.z(j) - posZ[i];
+					if ((dx * dx) + (dy * dy) + (dz * dz) < reach && !prey.claims.isSettled(j)) {
+						break;
+					}
+				}
+				targets[i] = j;
+			}
+			if (j < n) {
+				prey.claims.claim(j, ids[i]);
+			}
+		}, 64);
+		// winners settle their prey, losers scan on from the prey they lost,
+		// which is settled by then. Each round settles at least one claim.
+		unsigned int left = 0;
+		for (unsigned int h = 0; h < pending; h++) {
+			unsigned int i = hunters[h];
+			unsigned int j = targets[i];
+			if (near != NULL) {
+				const unsigned int* list;
+				unsigned int count = near->getCandidates(passIndex[i], list);
+				j = j < count ? list[j] : n;
+			}
+			if (j == n) {
+				continue;
+			}
+			if (prey.claims.owns(j, ids[i])) {
+				prey.claims.settle(j);
+			} else {
+				hunters[left++] = i;
+			}
+		}
+		pending = left;
+	}
+	prey.removeEaten();
+}
+
+void FlockItem::removeEaten() {
+	TRACE_SCOPE("remove eaten");
+	const unsigned int n = amnt;
+	// survivors per chunk, scanned into each chunk's first output index
+	const unsigned int workers = chunkWorkers(n);
+	chunkCounts.assign(workers + 1, 0);
+	parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+		unsigned int count = 0;
+		for (unsigned int i = b; i < e; i++) {
+			count += claims.isSettled(i) ? 0 : 1;
+		}
+		chunkCounts[w + 1] = count;
+	});
+	for (unsigned int w = 0; w < workers; w++) {
+		chunkCounts[w + 1] += chunkCounts[w];
+	}
+	const unsigned int kept = chunkCounts[workers];
+	if (kept == n) {
+		return;
+	}
+	unsigned int ownedEaten = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		if (claims.isSettled(i)) {
+			addToSums(i, -1.0);
+			ownedEaten += i < ghostBegin ? 1 : 0;
+		}
+	}
+	keepIndex.resize(kept);
+	parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+		unsigned int k = chunkCounts[w];
+		for (unsigned int i = b; i < e; i++) {
+			if (!claims.isSettled(i)) {
+				keepIndex[k++] = i;
 			}
 		}
+	});
+	gather(keepIndex.data(), kept);
+	// eaten ghosts are counted by the process that owns them
+	eatenTotal += ownedEaten;
+	ghostBegin -= ownedEaten;
+	amnt = kept;
+}
+
+void FlockItem::setIdStride(unsigned int offset, unsigned int stride) {
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		ids[i] = offset + (i * stride);
+	}
+	nextId = offset + (ids.size() * stride);
+	idStride = stride;
+}
+
+void FlockItem::getSums(double* sums) {
+	sums[0] = sumX;
+	sums[1] = sumY;
+	sums[2] = sumZ;
+#ifdef CARTESIAN
+	sums[3] = sumDirX;
+	sums[4] = sumDirY;
+	sums[5] = sumDirZ;
+#else
+	sums[3] = sumT;
+	sums[4] = sumE;
+	sums[5] = 0.0;
+#endif
+}
+
+void FlockItem::exportMembers(const unsigned int* index, unsigned int n, std::vector<MemberState>& out) {
+	const unsigned int first = out.size();
+	out.resize(first + n);
+	parallelFor(0, n, [&](unsigned int k) {
+		unsigned int i = index[k];
+		MemberState& m = out[first + k];
+		m.x = posX[i];
+		m.y = posY[i];
+		m.z = posZ[i];
+#ifdef CARTESIAN
+		m.h0 = dirX[i];
+		m.h1 = dirY[i];
+		m.h2 = dirZ[i];
+#else
+		m.h0 = rotTheta[i];
+		m.h1 = rotEpsilon[i];
+		m.h2 = 0.0f;
+#endif
+		m.vel = vels[i];
+		m.id = ids[i];
+	});
+}
+
+void FlockItem::appendGhosts(const MemberState* in, unsigned int n) {
+	const unsigned int first = amnt;
+	const unsigned int total = amnt + n;
+	posX.resize(total);
+	posY.resize(total);
+	posZ.resize(total);
+#ifdef CARTESIAN
+	dirX.resize(total);
+	dirY.resize(total);
+	dirZ.resize(total);
+#else
+	rotTheta.resize(total);
+	rotEpsilon.resize(total);
+#endif
+	vels.resize(total);
+	ids.resize(total);
+#ifdef COMPACT
+	fitAll(posX, &in[0].x, n, sizeof(MemberState));
+	fitAll(posY, &in[0].y, n, sizeof(MemberState));
+	fitAll(posZ, &in[0].z, n, sizeof(MemberState));
+#endif
+	parallelFor(0, n, [&](unsigned int k) {
+		unsigned int i = first + k;
+		posX[i] = in[k].x;
+		posY[i] = in[k].y;
+		posZ[i] = in[k].z;
+#ifdef CARTESIAN
+		dirX[i] = in[k].h0;
+		dirY[i] = in[k].h1;
+		dirZ[i] = in[k].h2;
+#else
+		rotTheta[i] = in[k].h0;
+		rotEpsilon[i] = in[k].h1;
+#endif
+		vels[i] = in[k].vel;
+		ids[i] = in[k].id;
+	});
+	for (unsigned int i = first; i < total; i++) {
+		addToSums(i, 1.0);
+		growBox(i);
 	}
-}
\ No newline at end of file
+	amnt = total;
+	dropCaches();
+}
+
+void FlockItem::appendMembers(const MemberState* in, unsigned int n) {
+	appendGhosts(in, n);
+	ghostBegin = amnt;
+}
+
+void FlockItem::dropGhosts() {
+	if (ghostBegin == (unsigned int) amnt) {
+		return;
+	}
+	for (unsigned int i = ghostBegin; i < (unsigned int) amnt; i++) {
+		addToSums(i, -1.0);
+	}
+	posX.resize(ghostBegin);
+	posY.resize(ghostBegin);
+	posZ.resize(ghostBegin);
+#ifdef CARTESIAN
+	dirX.resize(ghostBegin);
+	dirY.resize(ghostBegin);
+	dirZ.resize(ghostBegin);
+#else
+	rotTheta.resize(ghostBegin);
+	rotEpsilon.resize(ghostBegin);
+#endif
+	vels.resize(ghostBegin);
+	ids.resize(ghostBegin);
+	amnt = ghostBegin;
+	dropCaches();
+}
+
+void FlockItem::keepMembers(const unsigned int* index, unsigned int n) {
+	gather(index, n);
+	amnt = n;
+	ghostBegin = n;
+	recomputeSums();
+}
@@ -1,22 +1,131 @@
 // Copyright 2014 Aaron Baker (bakeraj4)
 
+// Carry a unit direction vector per particle instead of spherical angles.
+// The angles are only derived when they are asked for.
+// #define CARTESIAN
+
 #include <vector>
 #include <string>
 #include <sstream>
+#include "ClaimTable.h"
+#include "OutOfCore.h"
+#include "Compact.h"
+#ifdef OUT_OF_CORE
+#define Vec std::vector<float, MappedAllocator<float> >
+#define Ids std::vector<unsigned int, MappedAllocator<unsigned int> >
+#else
 #define Vec std::vector<float>
+#define Ids std::vector<unsigned int>
+#endif
+#ifdef COMPACT
+#define PosVec FixedVec
+#define RotVec AngleVec
+#define PosScratch Shorts
+#else
+#define PosVec Vec
+#define RotVec Vec
+#define PosScratch Vec
+#endif
 #pragma once
 
+// a predator eats a prey closer than this
+#define THRESHHOLD 0.5f
+
+class ProximityPass;
+
+// One member's whole state, for moving members between flocks or processes.
+struct MemberState {
+	float x, y, z;
+	// rotTheta, rotEpsilon and 0, or the direction with CARTESIAN
+	float h0, h1, h2;
+	float vel;
+	unsigned int id;
+};
+
+// the running totals getSums hands out: position, then theta and epsilon
+// and 0, or the direction with CARTESIAN
+#define FLOCK_SUMS 6
+
 class FlockItem{
     private:
-        Vec posX, posY, posZ, rotTheta, rotEpsilon, vels;
+        PosVec posX, posY, posZ;
+		RotVec rotTheta, rotEpsilon;
+		Vec vels;
+#ifdef CARTESIAN
+		Vec dirX, dirY, dirZ;
+#endif
+		// running totals behind the flock averages, kept up to date by
+		// every method that changes a particle
+		double sumX, sumY, sumZ;
+#ifdef CARTESIAN
+		double sumDirX, sumDirY, sumDirZ;
+#else
+		double sumT, sumE;
+#endif
+		int movesSinceResync;
+		// per step heading cache, see cacheHeadings. CARTESIAN has the unit
+		// heading in dirX, dirY, dirZ already.
+#ifndef CARTESIAN
+		Vec headX, headY, headZ;
+#endif
+		Vec headSinT;
+		bool headingsValid;
+		// after a change to any heading or member, drops what was derived
+		void dropCaches();
+#ifdef COMPACT
+		// float copies of the 16 bit arrays for the pointer getters, made
+		// when one is asked for after a change
+		Vec wideX, wideY, wideZ, wideT, wideE;
+		bool wideValid;
+		void widen();
+		// how far the stored positions are from the float ones every move
+		// would have given, see precisionReport
+		double roundSq, roundMax;
+		unsigned long rounds;
+		void noteRounding(float stored, float exact);
+#endif
+		// axis aligned box around every position, refitted by move() and only
+		// grown in between, so it may be loose after removals
+		float boxMin[3], boxMax[3];
+		void clearBox();
+		void growBox(unsigned int index);
+		// stable particle ids that survive removals and reorders
+		Ids ids;
+		unsigned int nextId, idStride;
+		// members from ghostBegin on are copies of another process's members,
+		// see appendGhosts
+		unsigned int ghostBegin;
+		Vec scratch;
+		PosScratch posScratch;
+		Ids idScratch;
+		// keeps particle from[i] at index i for i < n, in every array
+		void gather(const unsigned int* from, unsigned int n);
+		// eatPrey state: claims on this flock as prey, and on the predator
+		// side the members still hunting and where each one's scan resumes
+		ClaimTable claims;
+		std::vector<unsigned int> hunters, targets, passIndex;
+		// survivor counts per chunk and the survivors' old indices
+		std::vector<unsigned int> chunkCounts, keepIndex;
+		void removeEaten();
+		// members of this flock eaten so far
+		unsigned long eatenTotal;
 		int amnt, threshold;
 		int foodChainLevel;
 		std::string pName;
-		void addSingleParticle(float px, float py, float pz);
+		void setHeading(float theta, float epsilon, int index);
+		// setHeading without the running totals, for the parallel setups
+		// that recompute them after
+		void writeHeading(float theta, float epsilon, unsigned int index);
 		void initVecs(int nMembers);
+		// the rest of a constructor once the arrays are filled
+		void finishInit(int level, std::string& name, int nMembers);
+		void addToSums(unsigned int index, double sign);
 		void move(unsigned int index);
     public:
         FlockItem(int level, std::string& name, int nMembers);
+		// nMembers members from state, the x, y, z, theta, epsilon and vel
+		// arrays of nMembers each, see Scenario.h
+		FlockItem(int level, std::string& name, int nMembers, const float* const* state);
 		
 		void removeParticleI(unsigned int index);
 		void decrementAmnt();
@@ -32,12 +141,29 @@ class FlockItem{
 		Vec getRotEpsilon();
 		Vec getVels();
 
+		// direct access to the arrays, valid until the flock changes size.
+		// With COMPACT these are float copies made on the first call after a
+		// change, valid until the next change, so never call them from
+		// inside a parallel loop.
+		float* getPosXPtr();
+		float* getPosYPtr();
+		float* getPosZPtr();
+		float* getRotThetaPtr();
+		float* getRotEpsilonPtr();
+		float* getVelsPtr();
+		// the positions as they are stored, safe to read from any thread
+		PosView posView();
+		// theta and epsilon likewise, not with CARTESIAN, which derives them
+		// from the direction
+		AngleView angleView();
+
 		float getPosX(int index);
 		float getPosY(int index);
 		float getPosZ(int index);
 		float getRotTheta(int index);
 		float getRotEpsilon(int index);
 		float getVels(int index);
+		unsigned int getId(int index);
 
 		void addPosX(float n_x, int index);
 		void addPosY(float n_y, int index);
@@ -48,10 +174,83 @@ class FlockItem{
 		void setRotTheta(float n_x, int index);
 		void setRotEpsilon(float n_y, int index);
 
+		// Recomputes the heading cache, in parallel, if any heading or member
+		// changed since the last call. The pointers below are only valid after
+		// it until the next change, and the reads may come from any thread.
+		void cacheHeadings();
+		// unit heading, and sin(theta) with cos(theta) being the heading's z
+		const float* getHeadXPtr();
+		const float* getHeadYPtr();
+		const float* getHeadZPtr();
+		const float* getHeadSinTPtr();
+		// the arrays a pass over this flock's members reads, for streamChunks
+		StreamArrays streamArrays();
+
+#ifdef CARTESIAN
+		float getDirX(int index);
+		float getDirY(int index);
+		float getDirZ(int index);
+		// (x, y, z) must already be a unit vector
+		void setDir(float x, float y, float z, int index);
+#endif
+
+		// flock averages in O(1) from the running totals
+		float getAvePosX();
+		float getAvePosY();
+		float getAvePosZ();
+#ifdef CARTESIAN
+		float getAveDirX();
+		float getAveDirY();
+		float getAveDirZ();
+#else
+		float getAveRotT();
+		float getAveRotE();
+#endif
+		// rebuilds the running totals from scratch to drop rounding drift
+		void recomputeSums();
+
+		unsigned long getEatenTotal() { return eatenTotal; }
+#ifdef COMPACT
+		// rms and largest position rounding per move, the step and the rebases
+		std::string precisionReport();
+#endif
+
+		// Renumbers the ids to offset, offset + stride, ... and hands out
+		// newborn ids the same way, so flocks that share a name across
+		// processes never share an id.
+		void setIdStride(unsigned int offset, unsigned int stride);
+		void getSums(double* sums);
+		// appends index[0 .. n - 1]'s states to out
+		void exportMembers(const unsigned int* index, unsigned int n, std::vector<MemberState>& out);
+		// adds members, which must not be done while there are ghosts
+		void appendMembers(const MemberState* in, unsigned int n);
+		// keeps only index[0 .. n - 1], in that order, with no ghosts
+		void keepMembers(const unsigned int* index, unsigned int n);
+		// Ghosts are read only copies of nearby members owned by another
+		// process. The behaviors and eatPrey treat them as members, but only
+		// the members before them count as eaten and dropGhosts removes
+		// whatever is left of them.
+		void appendGhosts(const MemberState* in, unsigned int n);
+		void dropGhosts();
+		unsigned int getOwned() { return ghostBegin; }
+
+		const float* getBoxMin() { return boxMin; }
+		const float* getBoxMax() { return boxMax; }
+		// squared distance between this flock's box and other's, 0 if they
+		// overlap. No two members are closer than this.
+		float boxGap2(FlockItem& other);
+
+		// moves particle perm[i] to index i in every per-particle array
+		void reorder(const unsigned int* perm);
+
 		void move();
+		// adds amnt / 2 newborns at (ax, ay, az) in one batch
 		void populate(float ax, float ay, float az);
-		// eat prey should be called before move
-		void eatPrey(FlockItem& prey);
+		// eat prey should be called before move. Each member eats at most one
+		// prey in reach, and a prey in reach of several goes to the lowest id.
+		// With near, the step's pass over this flock and prey, the prey in
+		// reach come from it instead of a search over the whole prey flock.
+		void eatPrey(FlockItem& prey, const ProximityPass* near = NULL);
 
 		std::string toString() {
 			std::stringstream  ss;
@@ -0,0 +1,357 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Log.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// records per thread before the logging thread has to wait on the flusher
+#define RING_SIZE 1024
+// bytes of text in one record, longer text takes several records
+#define TEXT_SIZE 88
+#define FLUSH_PERIOD_MS 50
+#define PROGRESS_PERIOD_MS 5000
+
+namespace {
+
+enum Kind {
+	TEXT,
+	// a piece of text that the next record continues
+	TEXT_MORE,
+	PROGRESS,
+	GENERATION,
+	FLOCK,
+	END_GENERATION
+};
+
+// formatted by the flusher, see format
+struct Record {
+	unsigned long seq;
+	unsigned char kind;
+	unsigned char sink;
+	int a;
+	unsigned int b;
+	float value;
+	char text[TEXT_SIZE];
+};
+
+// single producer, single consumer: only the owning thread moves head and
+// only the flusher moves tail
+struct Ring {
+	Record slots[RING_SIZE];
+	std::atomic<unsigned long> head;
+	std::atomic<unsigned long> tail;
+	// set once the owning thread exits, the flusher frees the ring after
+	// draining it
+	std::atomic<bool> retired;
+	Ring() : head(0), tail(0), retired(false) {}
+};
+
+std::atomic<bool> running(false);
+std::atomic<unsigned long> nextSeq(0);
+std::atomic<unsigned long> drops(0);
+std::atomic<long long> lastProgress(-PROGRESS_PERIOD_MS);
+volatile std::sig_atomic_t pendingSignal = 0;
+
+std::mutex registryLock;
+std::vector<Ring*> rings;
+std::mutex wakeLock;
+std::condition_variable wake;
+// a thread whose ring is full sleeps on room until the flusher drains it
+std::mutex roomLock;
+std::condition_variable room;
+std::thread flusher;
+// one per sink, the console's is never opened
+std::ofstream files[Log::SINKS];
+// taken by the flusher while it writes and by open
+std::mutex fileLock;
+
+void closeFiles() {
+	for (int i = 0; i < Log::SINKS; i++) {
+		files[i].close();
+	}
+}
+
+// the calling thread's ring, handed to the flusher to free when it exits
+struct RingHolder {
+	Ring* ring;
+	RingHolder() : ring(NULL) {}
+	~RingHolder() {
+		if (ring != NULL) {
+			ring->retired.store(true, std::memory_order_release);
+		}
+	}
+};
+thread_local RingHolder holder;
+
+Ring* myRing() {
+	if (holder.ring == NULL) {
+		holder.ring = new Ring();
+		std::lock_guard<std::mutex> lock(registryLock);
+		rings.push_back(holder.ring);
+	}
+	return holder.ring;
+}
+
+long long nowMs() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Waits for room unless canDrop, in which case a full ring drops the records.
+// All count records of one call go in or none do.
+bool push(Record* records, unsigned int count, bool canDrop) {
+	if (!running.load(std::memory_order_acquire)) {
+		return false;
+	}
+	Ring* ring = myRing();
+	unsigned long h = ring->head.load(std::memory_order_relaxed);
+	auto hasRoom = [&]() {
+		return h + count - ring->tail.load(std::memory_order_acquire) <= RING_SIZE;
+	};
+	if (!hasRoom() && !canDrop) {
+		// drain now rather than at the next period
+		wake.notify_one();
+		std::unique_lock<std::mutex> lock(roomLock);
+		room.wait(lock, [&]() { return hasRoom() || !running.load(std::memory_order_acquire); });
+	}
+	if (!hasRoom()) {
+		drops.fetch_add(count, std::memory_order_relaxed);
+		return false;
+	}
+	// one block of sequence numbers so the pieces of a text stay together
+	unsigned long seq = nextSeq.fetch_add(count, std::memory_order_relaxed);
+	for (unsigned int i = 0; i < count; i++) {
+		records[i].seq = seq + i;
+		ring->slots[(h + i) % RING_SIZE] = records[i];
+	}
+	ring->head.store(h + count, std::memory_order_release);
+	return true;
+}
+
+void setText(Record& r, const char* text, size_t length) {
+	length = length < TEXT_SIZE - 1 ? length : TEXT_SIZE - 1;
+	memcpy(r.text, text, length);
+	r.text[length] = '\0';
+}
+
+Record makeRecord(Kind kind, Log::Sink sink) {
+	Record r;
+	r.kind = kind;
+	r.sink = sink;
+	r.a = 0;
+	r.b = 0;
+	r.value = 0.0f;
+	r.text[0] = '\0';
+	return r;
+}
+
+void format(const Record& r, std::ostream& out) {
+	switch (r.kind) {
+	case TEXT:
+		out << r.text << "\n";
+		break;
+	case TEXT_MORE:
+		out << r.text;
+		break;
+	case PROGRESS:
+		out << "Time passed = " << r.value << "\n";
+		break;
+	case GENERATION:
+		if (r.a == 0) {
+			out << "Generation 0 (input) at time = 0.0 seconds\n";
+		} else {
+			out << "Generation " << r.a << " at time " << r.value << " seconds\n";
+		}
+		break;
+	case FLOCK:
+		out << r.text << " has " << r.b << " at level " << r.a << "\n";
+		break;
+	case END_GENERATION:
+		out << "*******************************************************************************\n";
+		break;
+	}
+}
+
+// takes everything logged so far off the rings and writes it in the order it
+// was logged
+void drain() {
+	std::vector<Record> batch;
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		for (unsigned int i = 0; i < rings.size(); ) {
+			Ring* ring = rings[i];
+			// retired first, so every record of a retired ring is in head
+			bool retired = ring->retired.load(std::memory_order_acquire);
+			unsigned long t = ring->tail.load(std::memory_order_relaxed);
+			unsigned long h = ring->head.load(std::memory_order_acquire);
+			for (; t < h; t++) {
+				batch.push_back(ring->slots[t % RING_SIZE]);
+			}
+			ring->tail.store(h, std::memory_order_release);
+			if (retired) {
+				delete ring;
+				rings[i] = rings.back();
+				rings.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+	if (batch.empty()) {
+		return;
+	}
+	// taken so a thread cannot miss the notify between its check and its wait
+	{
+		std::lock_guard<std::mutex> lock(roomLock);
+	}
+	room.notify_all();
+	std::sort(batch.begin(), batch.end(), [](const Record& x, const Record& y) {
+		return x.seq < y.seq;
+	});
+	std::lock_guard<std::mutex> lock(fileLock);
+	std::ostringstream console;
+	for (unsigned int i = 0; i < batch.size(); i++) {
+		if (files[batch[i].sink].is_open()) {
+			format(batch[i], files[batch[i].sink]);
+		} else {
+			format(batch[i], console);
+		}
+	}
+	std::string text = console.str();
+	if (!text.empty()) {
+		fwrite(text.data(), 1, text.size(), stdout);
+		fflush(stdout);
+	}
+	for (int i = 0; i < Log::SINKS; i++) {
+		files[i].flush();
+	}
+}
+
+void onSignal(int sig) {
+	// only what is async-signal-safe here, the flusher does the rest
+	if (pendingSignal == 0) {
+		pendingSignal = sig;
+	}
+}
+
+void flushLoop() {
+	while (running.load(std::memory_order_acquire)) {
+		{
+			std::unique_lock<std::mutex> lock(wakeLock);
+			wake.wait_for(lock, std::chrono::milliseconds(FLUSH_PERIOD_MS));
+		}
+		drain();
+		int sig = pendingSignal;
+		if (sig != 0) {
+			// the simulation may still be logging, but what it logged before
+			// the signal is out
+			closeFiles();
+			signal(sig, SIG_DFL);
+			raise(sig);
+		}
+	}
+}
+
+}  // namespace
+
+bool Log::start(const std::string& fileName) {
+	if (running.exchange(true)) {
+		return files[DATA_FILE].is_open();
+	}
+	files[DATA_FILE].open(fileName.c_str());
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+#ifdef SIGHUP
+	signal(SIGHUP, onSignal);
+#endif
+	atexit(Log::shutdown);
+	flusher = std::thread(flushLoop);
+	return files[DATA_FILE].is_open();
+}
+
+bool Log::open(Sink sink, const std::string& fileName) {
+	if (sink == CONSOLE || sink >= SINKS) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(fileLock);
+	files[sink].open(fileName.c_str());
+	return files[sink].is_open();
+}
+
+void Log::shutdown() {
+	if (!running.exchange(false)) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(roomLock);
+	}
+	room.notify_all();
+	wake.notify_one();
+	if (flusher.joinable()) {
+		flusher.join();
+	}
+	// anything logged while the flusher was stopping
+	drain();
+	closeFiles();
+}
+
+void Log::text(Sink sink, const std::string& line) {
+	unsigned int count = line.empty() ? 1 : (line.size() + TEXT_SIZE - 2) / (TEXT_SIZE - 1);
+	if (count > RING_SIZE) {
+		count = RING_SIZE;
+	}
+	std::vector<Record> records(count, makeRecord(TEXT_MORE, sink));
+	for (unsigned int i = 0; i < count; i++) {
+		size_t begin = i * (TEXT_SIZE - 1);
+		setText(records[i], line.data() + begin, begin < line.size() ? line.size() - begin : 0);
+	}
+	records[count - 1].kind = TEXT;
+	push(records.data(), count, false);
+}
+
+void Log::progress(float minutes) {
+	long long now = nowMs();
+	long long last = lastProgress.load(std::memory_order_relaxed);
+	if (now - last < PROGRESS_PERIOD_MS
+			|| !lastProgress.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+		return;
+	}
+	Record r = makeRecord(PROGRESS, CONSOLE);
+	r.value = minutes;
+	push(&r, 1, true);
+}
+
+void Log::generation(int number, float seconds) {
+	Record r = makeRecord(GENERATION, DATA_FILE);
+	r.a = number;
+	r.value = seconds;
+	push(&r, 1, false);
+}
+
+void Log::flock(const std::string& name, unsigned int amnt, int level) {
+	Record r = makeRecord(FLOCK, DATA_FILE);
+	r.a = level;
+	r.b = amnt;
+	setText(r, name.data(), name.size());
+	push(&r, 1, false);
+}
+
+void Log::endGeneration() {
+	Record r = makeRecord(END_GENERATION, DATA_FILE);
+	push(&r, 1, false);
+}
+
+unsigned long Log::dropped() {
+	return drops.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,50 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <string>
+#pragma once
+
+// Logging off the simulation thread. Every thread that logs gets its own
+// single producer ring of fixed size records, so logging is a copy and a
+// release store. A background flusher drains the rings every FLUSH_PERIOD_MS,
+// orders the records by when they were logged, formats them and writes them
+// to the console or the log file.
+//
+// Only progress lines give way to a full ring, everything else sleeps until
+// the flusher has drained it and is only lost on a hard crash. shutdown()
+// drains everything and also runs at exit, and SIGINT / SIGTERM / SIGHUP are
+// turned into a drain on the flusher before the signal is raised again with
+// its default action.
+class Log {
+public:
+	enum Sink {
+		CONSOLE,
+		DATA_FILE,
+		// the in-situ statistics, see Analytics.h
+		STATS_FILE,
+		SINKS
+	};
+
+	// opens fileName for the DATA_FILE sink and starts the flusher; false if the
+	// file could not be opened, the console still works then
+	static bool start(const std::string& fileName);
+	// opens fileName for another file sink, before anything is logged to it.
+	// Records for a sink without a file go to the console.
+	static bool open(Sink sink, const std::string& fileName);
+	// drains every ring, closes the file and stops the flusher. Anything
+	// logged afterwards is dropped.
+	static void shutdown();
+
+	// free text, one line per call
+	static void text(Sink sink, const std::string& line);
+	// "Time passed = minutes" on the console, at most once per
+	// PROGRESS_PERIOD_MS of wall time however often it is called
+	static void progress(float minutes);
+	// the start of a generation's block in the log file, generation 0 is the
+	// input. Follow it with one flock() per flock and an endGeneration().
+	static void generation(int number, float seconds);
+	static void flock(const std::string& name, unsigned int amnt, int level);
+	static void endGeneration();
+
+	// records that could not be logged because their ring stayed full
+	static unsigned long dropped();
+};
@@ -0,0 +1,96 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "MortonOrder.h"
+#include "Parallel.h"
+
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+// 3 axes * 10 bits
+#define KEY_BITS 30
+
+// spreads the low 10 bits of v so there are two zero bits between each
+static unsigned int spreadBits(unsigned int v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+unsigned int MortonOrder::mortonCode(float x, float y, float z,
+		float minX, float minY, float minZ, float scale) {
+	unsigned int qx = (unsigned int) ((x - minX) * scale);
+	unsigned int qy = (unsigned int) ((y - minY) * scale);
+	unsigned int qz = (unsigned int) ((z - minZ) * scale);
+	return spreadBits(qx) | (spreadBits(qy) << 1) | (spreadBits(qz) << 2);
+}
+
+const unsigned int* MortonOrder::sort(const float* x, const float* y, const float* z, unsigned int n) {
+	keys.resize(n);
+	keysTmp.resize(n);
+	perm.resize(n);
+	permTmp.resize(n);
+	if (n == 0) {
+		return perm.data();
+	}
+	float minX = x[0], minY = y[0], minZ = z[0], maxX = x[0], maxY = y[0], maxZ = z[0];
+	for (unsigned int i = 1; i < n; i++) {
+		minX = x[i] < minX ? x[i] : minX;
+		minY = y[i] < minY ? y[i] : minY;
+		minZ = z[i] < minZ ? z[i] : minZ;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		maxY = y[i] > maxY ? y[i] : maxY;
+		maxZ = z[i] > maxZ ? z[i] : maxZ;
+	}
+	float extent = maxX - minX;
+	extent = (maxY - minY) > extent ? (maxY - minY) : extent;
+	extent = (maxZ - minZ) > extent ? (maxZ - minZ) : extent;
+	// one cube over the whole flock, 1023 keeps the far corner in 10 bits
+	float scale = extent > 0.0f ? 1023.0f / extent : 0.0f;
+
+	parallelFor(0, n, [&](unsigned int i) {
+		keys[i] = mortonCode(x[i], y[i], z[i], minX, minY, minZ, scale);
+		perm[i] = i;
+	});
+	radixSort(n);
+	return perm.data();
+}
+
+// Stable LSD radix sort of keys, carrying perm along. Every pass counts the
+// digits of each worker's chunk, turns the counts into per worker offsets and
+// lets every worker scatter its own chunk, which keeps the order stable.
+void MortonOrder::radixSort(unsigned int n) {
+	unsigned int workers = chunkWorkers(n);
+	counts.resize(workers * RADIX);
+	for (unsigned int shift = 0; shift < KEY_BITS; shift += RADIX_BITS) {
+		parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+			unsigned int* c = &counts[w * RADIX];
+			for (unsigned int d = 0; d < RADIX; d++) {
+				c[d] = 0;
+			}
+			for (unsigned int i = b; i < e; i++) {
+				c[(keys[i] >> shift) & (RADIX - 1)]++;
+			}
+		});
+		// exclusive scan in digit major, worker minor order
+		unsigned int sum = 0;
+		for (unsigned int d = 0; d < RADIX; d++) {
+			for (unsigned int w = 0; w < workers; w++) {
+				unsigned int c = counts[(w * RADIX) + d];
+				counts[(w * RADIX) + d] = sum;
+				sum += c;
+			}
+		}
+		parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+			unsigned int* offset = &counts[w * RADIX];
+			for (unsigned int i = b; i < e; i++) {
+				unsigned int dst = offset[(keys[i] >> shift) & (RADIX - 1)]++;
+				keysTmp[dst] = keys[i];
+				permTmp[dst] = perm[i];
+			}
+		});
+		keys.swap(keysTmp);
+		perm.swap(permTmp);
+	}
+}
@@ -0,0 +1,22 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <vector>
+#pragma once
+
+// Computes the permutation that puts a flock's particles in 3D Morton
+// (Z-order) order, so particles that are close in space are close in memory.
+// The buffers are kept between calls.
+class MortonOrder {
+private:
+	std::vector<unsigned int> keys, keysTmp, perm, permTmp;
+	// per worker digit counts, then the scatter offsets they turn into
+	std::vector<unsigned int> counts;
+	void radixSort(unsigned int n);
+public:
+	// 10 bits per axis of (x, y, z) inside the box [min, min + extent)
+	static unsigned int mortonCode(float x, float y, float z,
+		float minX, float minY, float minZ, float scale);
+
+	// perm[i] is the index of the particle that belongs at position i
+	const unsigned int* sort(const float* x, const float* y, const float* z, unsigned int n);
+};
@@ -0,0 +1,200 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Pipeline.h"
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// members closer than this to their nearest predator or prey steer every
+// step, two of eatPrey's reaches so the last steps before a capture are exact
+#define FAR_DISTANCE (2.0f * THRESHHOLD)
+// a kept hunt or hide turn is redone once its target is this fraction nearer
+// or farther than when it was computed
+#define REUSE_BOUND 0.1f
+// steps between refreshes to start with, the flock terms on a slower clock
+#define PURSUIT_PERIOD 4
+#define FLOCK_PERIOD 8
+// the longest the audits may stretch either clock to
+#define MAX_PERIOD 32
+// steps between audits against full rate stepping
+#define AUDIT_PERIOD 32
+// rms turn error in radians the audits hold each flock to, MULTIRATE:budget
+#define DEFAULT_BUDGET 1e-4f
+
+// the PREDATOR_PREY pipeline split by how fast each part changes
+typedef Compose<Hunt<HuntWeight>, HideFromOne<HideFromOneWeight>, HideFromAll<HideFromAllWeight> > PursuitTerms;
+typedef Compose<Align<AlignWeight>, Seperate<SeperateWeight>, Cohere<CohesionWeight> > FlockTerms;
+typedef Compose<Hunt<HuntWeight>, HideFromOne<HideFromOneWeight>, HideFromAll<HideFromAllWeight>,
+	Align<AlignWeight>, Seperate<SeperateWeight>, Cohere<CohesionWeight> > FullRateTerms;
+
+// The PREDATOR_PREY pipeline with each member's turn kept between steps and
+// only parts of it redone:
+// - hunt and hide every PURSUIT_PERIOD steps, but every step for members
+//   within FAR_DISTANCE of their target, and whenever the nearest target is
+//   another member or has moved REUSE_BOUND nearer or farther
+// - alignment, seperation and cohesion every FLOCK_PERIOD steps
+// - everything for a member that is new at its index, after eating,
+//   populating or a reorder
+// The members' refreshes are staggered so each step does a share of them.
+// Every AUDIT_PERIOD steps the whole flock is also stepped at full rate and
+// the rms difference is held to the budget by halving or doubling both
+// periods. The totals are in report().
+class MultiRateBackend : public ScalarBackend {
+private:
+	struct FlockRate {
+		std::string name;
+		std::vector<float> pursuitT, pursuitE, flockT, flockE, fullT, fullE;
+		// the member each cache entry was computed for, its target and the
+		// target's squared distance then
+		std::vector<unsigned int> ids, targetIds;
+		std::vector<float> targetDist2;
+		unsigned int step, pursuitPeriod, flockPeriod;
+		std::vector<unsigned long> workerPursuit, workerFlock;
+		unsigned long members, pursuitRuns, flockRuns;
+		unsigned int audits;
+		double errorSum, errorMax;
+
+		FlockRate() : step(0), pursuitPeriod(PURSUIT_PERIOD), flockPeriod(FLOCK_PERIOD), members(0),
+			pursuitRuns(0), flockRuns(0), audits(0), errorSum(0.0), errorMax(0.0) {}
+	};
+	// by food chain level
+	std::map<int, FlockRate> rates;
+	float budget;
+
+	// steps the whole flock at full rate and compares it to t and e
+	void audit(FlockRate& r, const SteerView& v, unsigned int n, const float* t, const float* e) {
+		TRACE_SCOPE("multirate audit");
+		r.fullT.resize(n);
+		r.fullE.resize(n);
+		parallelFor(0, n, [&](unsigned int i) {
+			float ft = 0.0f, fe = 0.0f;
+			FullRateTerms::add(v, i, ft, fe);
+			r.fullT[i] = ft;
+			r.fullE[i] = fe;
+		}, 256);
+		double sq = 0.0;
+		for (unsigned int i = 0; i < n; i++) {
+			sq += ((t[i] - r.fullT[i]) * (t[i] - r.fullT[i])) + ((e[i] - r.fullE[i]) * (e[i] - r.fullE[i]));
+		}
+		const double rms = n > 0 ? sqrt(sq / (2.0 * n)) : 0.0;
+		r.audits++;
+		r.errorSum += rms;
+		r.errorMax = rms > r.errorMax ? rms : r.errorMax;
+		if (rms > budget) {
+			r.pursuitPeriod = r.pursuitPeriod > 1 ? r.pursuitPeriod / 2 : 1;
+			r.flockPeriod = r.flockPeriod > 1 ? r.flockPeriod / 2 : 1;
+		} else if (rms < budget / 4.0f) {
+			r.pursuitPeriod = r.pursuitPeriod < MAX_PERIOD ? r.pursuitPeriod * 2 : MAX_PERIOD;
+			r.flockPeriod = r.flockPeriod < MAX_PERIOD ? r.flockPeriod * 2 : MAX_PERIOD;
+		}
+	}
+
+public:
+	MultiRateBackend(float errorBudget) : budget(errorBudget) {}
+
+	std::string report() {
+		std::stringstream ss;
+		for (std::map<int, FlockRate>::iterator it = rates.begin(); it != rates.end(); ++it) {
+			const FlockRate& r = it->second;
+			const double saved = r.members > 0 ?
+				100.0 * (1.0 - ((r.pursuitRuns + r.flockRuns) / (2.0 * r.members))) : 0.0;
+			ss << (it == rates.begin() ? "" : "\n") << "MULTIRATE " << r.name << ": " << r.pursuitRuns << " hunt/hide and " << r.flockRuns
+				<< " flock refreshes for " << r.members << " member steps, " << saved << "% saved. "
+				<< r.audits << " audits against full rate: rms turn error mean "
+				<< (r.audits > 0 ? r.errorSum / r.audits : 0.0) << " max " << r.errorMax
+				<< " radians (budget " << budget << "), periods now " << r.pursuitPeriod << " and "
+				<< r.flockPeriod;
+		}
+		return ss.str();
+	}
+
+	std::string getName() { return "MULTIRATE"; }
+
+	bool steer(FlockItem& me, const SteerInputs& in, float* t, float* e) {
+		FlockRate& r = rates[me.getLevel()];
+		r.name = me.getPName();
+		const unsigned int n = me.getAmnt();
+		// entries past the old size are for no member yet
+		const unsigned int none = ~0u;
+		r.pursuitT.resize(n);
+		r.pursuitE.resize(n);
+		r.flockT.resize(n);
+		r.flockE.resize(n);
+		r.ids.resize(n, none);
+		r.targetIds.resize(n, none);
+		r.targetDist2.resize(n, 0.0f);
+		const SteerView v(me, in);
+		FlockItem* other = in.prey != NULL ? in.prey : in.pred;
+		const unsigned int* nearest = in.prey != NULL ? in.nearestPrey : in.nearestPred;
+		const PosView o = other != NULL ? other->posView() : v.me;
+		const float far2 = FAR_DISTANCE * FAR_DISTANCE;
+		const float low = (1.0f - REUSE_BOUND) * (1.0f - REUSE_BOUND);
+		const float high = (1.0f + REUSE_BOUND) * (1.0f + REUSE_BOUND);
+		const unsigned int step = r.step++;
+		const unsigned int workers = chunkWorkers(n, 256);
+		r.workerPursuit.assign(workers, 0);
+		r.workerFlock.assign(workers, 0);
+		parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				for (unsigned int i = cb; i < ce; i++) {
+					const unsigned int id = me.getId(i);
+					const bool stale = r.ids[i] != id;
+					r.ids[i] = id;
+					bool pursue = stale || (step + i) % r.pursuitPeriod == 0;
+					unsigned int targetId = none;
+					float d2 = 0.0f;
+					if (other != NULL && nearest != NULL) {
+						unsigned int k = nearest[i];
+						float dx = o.x(k) - v.me.x(i), dy = o.y(k) - v.me.y(i), dz = o.z(k) - v.me.z(i);
+						d2 = (dx * dx) + (dy * dy) + (dz * dz);
+						targetId = other->getId(k);
+						pursue = pursue || d2 < far2 || targetId != r.targetIds[i]
+							|| d2 < r.targetDist2[i] * low || d2 > r.targetDist2[i] * high;
+					}
+					if (pursue) {
+						float pt = 0.0f, pe = 0.0f;
+						PursuitTerms::add(v, i, pt, pe);
+						r.pursuitT[i] = pt;
+						r.pursuitE[i] = pe;
+						r.targetIds[i] = targetId;
+						r.targetDist2[i] = d2;
+						r.workerPursuit[w]++;
+					}
+					if (stale || (step + i) % r.flockPeriod == 0) {
+						float ft = 0.0f, fe = 0.0f;
+						FlockTerms::add(v, i, ft, fe);
+						r.flockT[i] = ft;
+						r.flockE[i] = fe;
+						r.workerFlock[w]++;
+					}
+					t[i] = r.pursuitT[i] + r.flockT[i];
+					e[i] = r.pursuitE[i] + r.flockE[i];
+				}
+			});
+		}, 256);
+		r.members += n;
+		for (unsigned int w = 0; w < workers; w++) {
+			r.pursuitRuns += r.workerPursuit[w];
+			r.flockRuns += r.workerFlock[w];
+		}
+		if (step % AUDIT_PERIOD == AUDIT_PERIOD - 1) {
+			audit(r, v, n, t, e);
+		}
+		return true;
+	}
+};
+
+// MULTIRATE or MULTIRATE:budget, the rms turn error in radians
+static BackendPtr makeMultiRate(const BackendArgs& args) {
+	float budget = DEFAULT_BUDGET;
+	if (!args.options.empty()) {
+		try {
+			budget = std::stof(args.options);
+		} catch (const std::exception&) {
+			throw std::runtime_error("MULTIRATE takes an error budget in radians, e.g. MULTIRATE:0.0001");
+		}
+	}
+	return BackendPtr(new MultiRateBackend(budget));
+}
+
+static BackendRegistrar multiRateReg("MULTIRATE", makeMultiRate);
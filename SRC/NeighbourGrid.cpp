@@ -0,0 +1,58 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "NeighbourGrid.h"
+#include <math.h>
+
+// upper bound on cells per particle, keeps a spread out flock from
+// producing a mostly empty grid
+#define CELLS_PER_PARTICLE 2
+#define MIN_CELLS 64
+
+void NeighbourGrid::build(const float* x, const float* y, const float* z, unsigned int n, float radius) {
+	float maxX, maxY, maxZ;
+	minX = maxX = (n > 0) ? x[0] : 0.0f;
+	minY = maxY = (n > 0) ? y[0] : 0.0f;
+	minZ = maxZ = (n > 0) ? z[0] : 0.0f;
+	for (unsigned int i = 1; i < n; i++) {
+		minX = x[i] < minX ? x[i] : minX;
+		minY = y[i] < minY ? y[i] : minY;
+		minZ = z[i] < minZ ? z[i] : minZ;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		maxY = y[i] > maxY ? y[i] : maxY;
+		maxZ = z[i] > maxZ ? z[i] : maxZ;
+	}
+
+	// grow the cells until the grid fits the budget
+	double maxCells = (double) (n * CELLS_PER_PARTICLE > MIN_CELLS ? n * CELLS_PER_PARTICLE : MIN_CELLS);
+	cellSize = radius > 0.0f ? radius : 1.0f;
+	while ((floor((maxX - minX) / cellSize) + 1.0) * (floor((maxY - minY) / cellSize) + 1.0) *
+			(floor((maxZ - minZ) / cellSize) + 1.0) > maxCells) {
+		cellSize *= 2.0f;
+	}
+	dimX = (int) ((maxX - minX) / cellSize) + 1;
+	dimY = (int) ((maxY - minY) / cellSize) + 1;
+	dimZ = (int) ((maxZ - minZ) / cellSize) + 1;
+	unsigned int cells = dimX * dimY * dimZ;
+
+	// counting sort of the particles by cell
+	cellStart.assign(cells + 1, 0);
+	cellOf.resize(n);
+	sorted.resize(n);
+	for (unsigned int i = 0; i < n; i++) {
+		cellOf[i] = (((cellCoord(z[i], minZ, dimZ) * dimY) + cellCoord(y[i], minY, dimY)) * dimX) + cellCoord(x[i], minX, dimX);
+		cellStart[cellOf[i] + 1]++;
+	}
+	for (unsigned int c = 0; c < cells; c++) {
+		cellStart[c + 1] += cellStart[c];
+	}
+	// cellStart doubles as the insertion cursor of each cell
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int c = cellOf[i];
+		sorted[cellStart[c]++] = i;
+	}
+	// the scatter advanced every start to the next cell's start, shift back
+	for (unsigned int c = cells; c > 0; c--) {
+		cellStart[c] = cellStart[c - 1];
+	}
+	cellStart[0] = 0;
+}
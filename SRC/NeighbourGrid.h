@@ -0,0 +1,42 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <vector>
+#pragma once
+
+// Uniform cell list over one flock's positions. The particles are bucketed
+// by a counting sort, so each cell's members sit next to each other in
+// sorted and a query only touches the 27 cells around a point.
+class NeighbourGrid {
+private:
+	float minX, minY, minZ, cellSize;
+	int dimX, dimY, dimZ;
+	// cellStart[c] .. cellStart[c + 1] is the slice of sorted in cell c
+	std::vector<unsigned int> cellStart, sorted, cellOf;
+	int cellCoord(float v, float min, int dim) const {
+		int c = (int) ((v - min) / cellSize);
+		return c < 0 ? 0 : (c >= dim ? dim - 1 : c);
+	}
+public:
+	NeighbourGrid() : minX(0.0f), minY(0.0f), minZ(0.0f), cellSize(1.0f), dimX(1), dimY(1), dimZ(1) {}
+
+	// cells are at least radius wide, so every neighbour within radius is in
+	// one of the 27 cells around a particle's own
+	void build(const float* x, const float* y, const float* z, unsigned int n, float radius);
+
+	// calls f(index) for every particle that may be within radius of (x, y, z),
+	// the caller still has to check the distance
+	template<typename F>
+	void forEachNear(float x, float y, float z, F f) const {
+		int cx = cellCoord(x, minX, dimX), cy = cellCoord(y, minY, dimY), cz = cellCoord(z, minZ, dimZ);
+		for (int k = (cz > 0 ? cz - 1 : 0); k <= cz + 1 && k < dimZ; k++) {
+			for (int j = (cy > 0 ? cy - 1 : 0); j <= cy + 1 && j < dimY; j++) {
+				for (int i = (cx > 0 ? cx - 1 : 0); i <= cx + 1 && i < dimX; i++) {
+					unsigned int c = (((k * dimY) + j) * dimX) + i;
+					for (unsigned int s = cellStart[c]; s < cellStart[c + 1]; s++) {
+						f(sorted[s]);
+					}
+				}
+			}
+		}
+	}
+};
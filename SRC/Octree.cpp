@@ -0,0 +1,167 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Octree.h"
+#include <math.h>
+
+// particles a node may hold before it is split
+#define LEAF_SIZE 8
+// coincident particles would split forever without a cap
+#define MAX_DEPTH 24
+
+void Octree::build(const float* px, const float* py, const float* pz, unsigned int n) {
+	x = px;
+	y = py;
+	z = pz;
+	nodes.clear();
+	order.resize(n);
+	scratch.resize(n);
+	for (unsigned int i = 0; i < n; i++) {
+		order[i] = i;
+	}
+	float minX, minY, minZ, maxX, maxY, maxZ;
+	minX = maxX = (n > 0) ? x[0] : 0.0f;
+	minY = maxY = (n > 0) ? y[0] : 0.0f;
+	minZ = maxZ = (n > 0) ? z[0] : 0.0f;
+	for (unsigned int i = 1; i < n; i++) {
+		minX = x[i] < minX ? x[i] : minX;
+		minY = y[i] < minY ? y[i] : minY;
+		minZ = z[i] < minZ ? z[i] : minZ;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		maxY = y[i] > maxY ? y[i] : maxY;
+		maxZ = z[i] > maxZ ? z[i] : maxZ;
+	}
+	// a cube, so every node's size is one number
+	float half = maxX - minX;
+	half = (maxY - minY) > half ? (maxY - minY) : half;
+	half = (maxZ - minZ) > half ? (maxZ - minZ) : half;
+	half = (half * 0.5f) + 0.000001f;
+	nodes.resize(1);
+	makeNode(0, (minX + maxX) * 0.5f, (minY + maxY) * 0.5f, (minZ + maxZ) * 0.5f, half, 0, n, 0);
+}
+
+void Octree::makeNode(unsigned int slot, float cx, float cy, float cz, float half,
+		unsigned int begin, unsigned int end, int depth) {
+	double sx = 0.0, sy = 0.0, sz = 0.0;
+	for (unsigned int k = begin; k < end; k++) {
+		sx += x[order[k]];
+		sy += y[order[k]];
+		sz += z[order[k]];
+	}
+	unsigned int count = end - begin;
+	// nodes may move when children are added, so write through the index
+	nodes[slot].cx = cx;
+	nodes[slot].cy = cy;
+	nodes[slot].cz = cz;
+	nodes[slot].half = half;
+	nodes[slot].count = count;
+	nodes[slot].comX = count > 0 ? (float) (sx / count) : cx;
+	nodes[slot].comY = count > 0 ? (float) (sy / count) : cy;
+	nodes[slot].comZ = count > 0 ? (float) (sz / count) : cz;
+	nodes[slot].begin = begin;
+	nodes[slot].end = end;
+	nodes[slot].firstChild = -1;
+	if (count <= LEAF_SIZE || depth == MAX_DEPTH) {
+		return;
+	}
+
+	// counting sort of the range by octant, bit 0 x, bit 1 y, bit 2 z
+	unsigned int start[9] = {0};
+	for (unsigned int k = begin; k < end; k++) {
+		unsigned int i = order[k];
+		unsigned int oct = (x[i] >= cx ? 1 : 0) | (y[i] >= cy ? 2 : 0) | (z[i] >= cz ? 4 : 0);
+		start[oct + 1]++;
+	}
+	for (int o = 0; o < 8; o++) {
+		start[o + 1] += start[o];
+	}
+	unsigned int cursor[8];
+	for (int o = 0; o < 8; o++) {
+		cursor[o] = begin + start[o];
+	}
+	for (unsigned int k = begin; k < end; k++) {
+		unsigned int i = order[k];
+		unsigned int oct = (x[i] >= cx ? 1 : 0) | (y[i] >= cy ? 2 : 0) | (z[i] >= cz ? 4 : 0);
+		scratch[cursor[oct]++] = i;
+	}
+	for (unsigned int k = begin; k < end; k++) {
+		order[k] = scratch[k];
+	}
+
+	unsigned int first = nodes.size();
+	nodes[slot].firstChild = first;
+	nodes.resize(first + 8);
+	float h = half * 0.5f;
+	for (int o = 0; o < 8; o++) {
+		makeNode(first + o, cx + ((o & 1) ? h : -h), cy + ((o & 2) ? h : -h), cz + ((o & 4) ? h : -h),
+			h, begin + start[o], begin + start[o + 1], depth + 1);
+	}
+}
+
+void Octree::field(float px, float py, float pz, int self, float theta, float* near, float* far) const {
+	near[0] = near[1] = near[2] = 0.0f;
+	far[0] = far[1] = far[2] = 0.0f;
+	if (nodes.empty()) {
+		return;
+	}
+	// depth first, at most 7 siblings wait on each level
+	unsigned int stack[8 * (MAX_DEPTH + 1)];
+	int top = 0;
+	stack[top++] = 0;
+	const float theta2 = theta * theta;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (node.count == 0) {
+			continue;
+		}
+		float dx = node.comX - px, dy = node.comY - py, dz = node.comZ - pz;
+		float d2 = (dx * dx) + (dy * dy) + (dz * dz);
+		float size = node.half * 2.0f;
+		if (node.firstChild >= 0 && size * size < theta2 * d2) {
+			// far enough to be one particle of weight count
+			float w = node.count;
+			if (self >= 0 && fabs(px - node.cx) <= node.half && fabs(py - node.cy) <= node.half &&
+					fabs(pz - node.cz) <= node.half) {
+				// only a huge theta accepts the node around p, take p back out
+				if (node.count == 1) {
+					continue;
+				}
+				w = node.count - 1.0f;
+				dx = ((node.comX * node.count) - px) / w - px;
+				dy = ((node.comY * node.count) - py) / w - py;
+				dz = ((node.comZ * node.count) - pz) / w - pz;
+				d2 = (dx * dx) + (dy * dy) + (dz * dz);
+			}
+			if (d2 > 0.0f) {
+				float inv = w / d2;
+				far[0] += dx * inv;
+				far[1] += dy * inv;
+				far[2] += dz * inv;
+				inv /= sqrt(d2);
+				near[0] += dx * inv;
+				near[1] += dy * inv;
+				near[2] += dz * inv;
+			}
+		} else if (node.firstChild >= 0) {
+			for (int o = 0; o < 8; o++) {
+				stack[top++] = node.firstChild + o;
+			}
+		} else {
+			for (unsigned int k = node.begin; k < node.end; k++) {
+				unsigned int i = order[k];
+				float qx = x[i] - px, qy = y[i] - py, qz = z[i] - pz;
+				float q2 = (qx * qx) + (qy * qy) + (qz * qz);
+				if ((int) i == self || q2 == 0.0f) {
+					continue;
+				}
+				float inv = 1.0f / q2;
+				far[0] += qx * inv;
+				far[1] += qy * inv;
+				far[2] += qz * inv;
+				inv /= sqrt(q2);
+				near[0] += qx * inv;
+				near[1] += qy * inv;
+				near[2] += qz * inv;
+			}
+		}
+	}
+}
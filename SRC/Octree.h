@@ -0,0 +1,41 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <vector>
+#include <cstddef>
+#pragma once
+
+// Barnes-Hut octree over one flock's positions. Every node keeps its centre
+// of mass and member count, so a query can treat a far away node as one
+// heavy particle. The opening angle theta trades accuracy for speed: 0 visits
+// every particle, and a large theta stops at the root, which is the flock
+// centroid.
+class Octree {
+private:
+	struct Node {
+		float cx, cy, cz, half;
+		float comX, comY, comZ;
+		unsigned int count;
+		// the 8 children are nodes[firstChild] .. nodes[firstChild + 7], a
+		// leaf has none and owns order[begin] .. order[end - 1] instead
+		int firstChild;
+		unsigned int begin, end;
+	};
+	std::vector<Node> nodes;
+	std::vector<unsigned int> order, scratch;
+	const float* x;
+	const float* y;
+	const float* z;
+	void makeNode(unsigned int slot, float cx, float cy, float cz, float half,
+		unsigned int begin, unsigned int end, int depth);
+public:
+	Octree() : x(NULL), y(NULL), z(NULL) {}
+
+	// the tree keeps the pointers, valid until the flock changes
+	void build(const float* x, const float* y, const float* z, unsigned int n);
+
+	// Sums over every particle q except self (-1 for none) of
+	//   near += (q - p) / |q - p|^3, a pull that falls off with 1 / d^2
+	//   far  += (q - p) / |q - p|^2, a pull that falls off with 1 / d
+	// where p = (px, py, pz). near and far are x, y, z and are overwritten.
+	void field(float px, float py, float pz, int self, float theta, float* near, float* far) const;
+};
@@ -0,0 +1,218 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// #define OPENCL_H
+
+#ifdef OPENCL_H
+#include "StepBackend.h"
+#include "ClCmdQueue.h"
+#include "Trace.h"
+#include <stdexcept>
+
+// kernel order, see kernelFuncts() in bakeraj4_project.cpp
+#define K_HUNT 0
+#define K_HIDE_FROM_HUNTER 1
+#define K_HIDE_FROM_HUNTERS 2
+#define K_ALIGN 3
+#define K_SEPERATE 4
+#define K_COHESION 5
+
+#ifdef TRACE
+// what the trace calls each kernel's commands
+static const char* const KERNEL_NAMES[] = {"hunt", "hideFromHunter", "hideFromHunters",
+	"align", "seperate", "cohesion"};
+#endif
+
+int getDevType(const std::string& device) {
+    const std::string DevTypes = "CPUGPUACC";
+    switch (DevTypes.find(device)) {
+    case 0: return CL_DEVICE_TYPE_CPU;
+    case 3: return CL_DEVICE_TYPE_GPU;
+    case 6: return CL_DEVICE_TYPE_ACCELERATOR;
+    }
+    throw std::runtime_error("Invalid device type specified");
+}
+
+// The kernels in "CL kernels", one queue per kernel. The buffers wrap the
+// FlockItem arrays (CL_MEM_USE_HOST_PTR), so the results land in t and e
+// once they are mapped back.
+class OpenCLBackend : public StepBackend {
+private:
+	std::string device;
+	std::vector<ClCmdQueue> queues;
+	std::vector<cl::Kernel> kernels;
+	// small inputs that need a host pointer of their own
+	float predPos[3], aveRot[2], avePos[3];
+
+	cl::Buffer in(int k, float* ptr, unsigned int n) {
+		return queues[k].makeBuffer(ptr, sizeof(float) * n, queues[k].ROFlags);
+	}
+
+	cl::Buffer out(int k, float* ptr, unsigned int n) {
+		return queues[k].makeBuffer(ptr, sizeof(float) * n, queues[k].WOFlags);
+	}
+
+	// run is the kernel's event, which the trace needs
+	void mapBack(int k, cl::Event& run, cl::Buffer& tBuff, cl::Buffer& eBuff, unsigned int n) {
+		cl::Event mapT, mapE;
+		{
+			TRACE_SCOPE("enqueueMapBuffer");
+			queues[k].getQueue().enqueueMapBuffer(tBuff, CL_TRUE, CL_MAP_READ, 0, n * sizeof(float), NULL, &mapT);
+			queues[k].getQueue().enqueueMapBuffer(eBuff, CL_TRUE, CL_MAP_READ, 0, n * sizeof(float), NULL, &mapE);
+		}
+#ifdef TRACE
+		traceCommands(k, run, mapT, mapE);
+#else
+		(void) run;
+#endif
+	}
+
+#ifdef TRACE
+	// The device clock is not the host's. mapE has just finished, so its end
+	// is taken to be now on the host and everything else is shifted with it.
+	void traceCommands(int k, cl::Event& run, cl::Event& mapT, cl::Event& mapE) {
+		if (!Trace::recording()) {
+			return;
+		}
+		long long offset = (long long) Trace::now() - (long long) mapE.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		traceCommand(KERNEL_NAMES[k], k, run, offset);
+		traceCommand("map t", k, mapT, offset);
+		traceCommand("map e", k, mapE, offset);
+	}
+
+	void traceCommand(const char* name, int k, cl::Event& ev, long long offset) {
+		Trace::device(name, k, hostTime(ev.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(), offset),
+			hostTime(ev.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(), offset),
+			hostTime(ev.getProfilingInfo<CL_PROFILING_COMMAND_START>(), offset),
+			hostTime(ev.getProfilingInfo<CL_PROFILING_COMMAND_END>(), offset));
+	}
+
+	static unsigned long long hostTime(cl_ulong device, long long offset) {
+		long long t = (long long) device + offset;
+		return t < 0 ? 0 : (unsigned long long) t;
+	}
+#endif
+
+	// hunt and hideFromHunter take the same arguments
+	void towardsNearest(int k, FlockItem& me, FlockItem& other, float* t, float* e) {
+		unsigned int n = me.getAmnt();
+		cl::Buffer myXBuff = in(k, me.getPosXPtr(), n);
+		cl::Buffer myYBuff = in(k, me.getPosYPtr(), n);
+		cl::Buffer myZBuff = in(k, me.getPosZPtr(), n);
+		cl::Buffer myRotT = in(k, me.getRotThetaPtr(), n);
+		cl::Buffer myRotE = in(k, me.getRotEpsilonPtr(), n);
+		cl::Buffer myVel = in(k, me.getVelsPtr(), n);
+		cl::Buffer itXBuff = in(k, other.getPosXPtr(), other.getAmnt());
+		cl::Buffer itYBuff = in(k, other.getPosYPtr(), other.getAmnt());
+		cl::Buffer itZBuff = in(k, other.getPosZPtr(), other.getAmnt());
+		cl::Buffer tBuff = out(k, t, n);
+		cl::Buffer eBuff = out(k, e, n);
+		cl::KernelFunctor funct(kernels[k], queues[k].getQueue(), cl::NullRange,
+			cl::NDRange(n), cl::NullRange);
+		cl::Event run = funct(myXBuff, myYBuff, myZBuff, myRotT, myRotE, myVel, itXBuff, itYBuff, itZBuff,
+			(int) n, other.getAmnt(), tBuff, eBuff);
+		mapBack(k, run, tBuff, eBuff, n);
+	}
+
+	// seperate and cohesion take the same arguments
+	void towardsAverage(int k, FlockItem& me, const float* ave, float* t, float* e) {
+		unsigned int n = me.getAmnt();
+		avePos[0] = ave[0];
+		avePos[1] = ave[1];
+		avePos[2] = ave[2];
+		cl::Buffer posXBuff = in(k, me.getPosXPtr(), n);
+		cl::Buffer posYBuff = in(k, me.getPosYPtr(), n);
+		cl::Buffer posZBuff = in(k, me.getPosZPtr(), n);
+		cl::Buffer rotTBuff = in(k, me.getRotThetaPtr(), n);
+		cl::Buffer rotEBuff = in(k, me.getRotEpsilonPtr(), n);
+		cl::Buffer avePosBuff = in(k, avePos, 3);
+		cl::Buffer velBuff = in(k, me.getVelsPtr(), n);
+		cl::Buffer tBuff = out(k, t, n);
+		cl::Buffer eBuff = out(k, e, n);
+		cl::KernelFunctor funct(kernels[k], queues[k].getQueue(), cl::NullRange,
+			cl::NDRange(n), cl::NullRange);
+		cl::Event run = funct(posXBuff, posYBuff, posZBuff, rotTBuff, rotEBuff, avePosBuff, (int) n, velBuff, tBuff, eBuff);
+		mapBack(k, run, tBuff, eBuff, n);
+	}
+
+public:
+	OpenCLBackend(const BackendArgs& args) {
+		device = args.options.empty() ? "GPU" : args.options;
+		int type = getDevType(device);
+		for (unsigned int i = 0; i < args.kernelFuncts.size(); i++) {
+			queues.push_back(ClCmdQueue(type));
+			kernels.push_back(queues[i].loadKernel(args.kernelFiles[i], args.kernelFuncts[i]));
+		}
+	}
+
+	std::string getName() { return "OPENCL:" + device; }
+
+	// the kernels search for the nearest member themselves
+	void hunt(FlockItem& me, FlockItem& prey, const unsigned int*, float* t, float* e) {
+		towardsNearest(K_HUNT, me, prey, t, e);
+	}
+
+	void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int*,
+			float* t, float* e) {
+		towardsNearest(K_HIDE_FROM_HUNTER, me, pred, t, e);
+	}
+
+	void hideFromPack(FlockItem& me, const float* pred, float* t, float* e) {
+		const int k = K_HIDE_FROM_HUNTERS;
+		unsigned int n = me.getAmnt();
+		predPos[0] = pred[0];
+		predPos[1] = pred[1];
+		predPos[2] = pred[2];
+		cl::Buffer preyXBuff = in(k, me.getPosXPtr(), n);
+		cl::Buffer preyYBuff = in(k, me.getPosYPtr(), n);
+		cl::Buffer preyZBuff = in(k, me.getPosZPtr(), n);
+		cl::Buffer preyRotT = in(k, me.getRotThetaPtr(), n);
+		cl::Buffer preyRotE = in(k, me.getRotEpsilonPtr(), n);
+		cl::Buffer preyVel = in(k, me.getVelsPtr(), n);
+		cl::Buffer predPosBuff = in(k, predPos, 3);
+		cl::Buffer tBuff = out(k, t, n);
+		cl::Buffer eBuff = out(k, e, n);
+		cl::KernelFunctor funct(kernels[k], queues[k].getQueue(), cl::NullRange,
+			cl::NDRange(n), cl::NullRange);
+		cl::Event run = funct(preyXBuff, preyYBuff, preyZBuff, preyRotT, preyRotE, preyVel, predPosBuff, (int) n, tBuff, eBuff);
+		mapBack(k, run, tBuff, eBuff, n);
+	}
+
+	void alignment(FlockItem& me, const float* rot, float* t, float* e) {
+		const int k = K_ALIGN;
+		unsigned int n = me.getAmnt();
+		aveRot[0] = rot[0];
+		aveRot[1] = rot[1];
+		cl::Buffer myRotT = in(k, me.getRotThetaPtr(), n);
+		cl::Buffer myRotE = in(k, me.getRotEpsilonPtr(), n);
+		cl::Buffer aveRotsBuff = in(k, aveRot, 2);
+		cl::Buffer tBuff = out(k, t, n);
+		cl::Buffer eBuff = out(k, e, n);
+		cl::KernelFunctor funct(kernels[k], queues[k].getQueue(), cl::NullRange,
+			cl::NDRange(n), cl::NullRange);
+		cl::Event run = funct(myRotT, myRotE, aveRotsBuff, (int) n, tBuff, eBuff);
+		mapBack(k, run, tBuff, eBuff, n);
+	}
+
+	void seperation(FlockItem& me, const float* ave, float* t, float* e) {
+		towardsAverage(K_SEPERATE, me, ave, t, e);
+	}
+
+	void cohesion(FlockItem& me, const float* ave, float* t, float* e) {
+		towardsAverage(K_COHESION, me, ave, t, e);
+	}
+};
+
+static BackendPtr makeOpenCL(const BackendArgs& args) {
+	return BackendPtr(new OpenCLBackend(args));
+}
+
+static BackendPtr makeOpenCLGPU(const BackendArgs& args) {
+	BackendArgs gpu = args;
+	gpu.options = "GPU";
+	return makeOpenCL(gpu);
+}
+
+static BackendRegistrar openclReg("OPENCL", makeOpenCL);
+// what (CPU|GPU) used to mean for an OpenCL build
+static BackendRegistrar gpuReg("GPU", makeOpenCLGPU);
+#endif
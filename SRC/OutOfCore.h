@@ -0,0 +1,133 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Keep the per member arrays in memory mapped files instead of anonymous
+// memory, so populations larger than RAM page to disk instead of being
+// killed. The files are made in $PARTICLE_SWAP_DIR, /tmp without it, and
+// removed as soon as they are mapped.
+// #define OUT_OF_CORE
+
+#include <cstddef>
+#pragma once
+
+// members per streamed chunk, 256 KB of each float array
+#define STREAM_CHUNK (1 << 16)
+// the most arrays one stream hints about
+#define STREAM_MAX_ARRAYS 24
+
+#ifdef OUT_OF_CORE
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// arrays smaller than this stay in anonymous memory
+#define MAPPED_MIN_BYTES (1 << 20)
+
+// Allocates large arrays as shared mappings of unlinked files. The kernel
+// writes their pages back to the file under memory pressure and reads them
+// in again on use, and the mappings are marked sequential so it reads ahead
+// and drops pages behind a pass.
+template<typename T>
+class MappedAllocator {
+public:
+	typedef T value_type;
+
+	MappedAllocator() {}
+	template<typename U>
+	MappedAllocator(const MappedAllocator<U>&) {}
+
+	T* allocate(std::size_t n) {
+		const std::size_t bytes = n * sizeof(T);
+		if (bytes < MAPPED_MIN_BYTES) {
+			return static_cast<T*>(::operator new(bytes));
+		}
+		const char* dir = getenv("PARTICLE_SWAP_DIR");
+		std::string name = std::string(dir != NULL ? dir : "/tmp") + "/particlesXXXXXX";
+		int fd = mkstemp(&name[0]);
+		if (fd < 0) {
+			throw std::bad_alloc();
+		}
+		unlink(name.c_str());
+		void* map = MAP_FAILED;
+		if (ftruncate(fd, bytes) == 0) {
+			map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (map == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		madvise(map, bytes, MADV_SEQUENTIAL);
+		return static_cast<T*>(map);
+	}
+
+	void deallocate(T* p, std::size_t n) {
+		const std::size_t bytes = n * sizeof(T);
+		if (bytes < MAPPED_MIN_BYTES) {
+			::operator delete(p);
+		} else {
+			munmap(p, bytes);
+		}
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const MappedAllocator<T>&, const MappedAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const MappedAllocator<T>&, const MappedAllocator<U>&) { return false; }
+#endif
+
+// The arrays a loop over members touches and their element sizes, for
+// streamChunks to hint about.
+struct StreamArrays {
+	const void* arrays[STREAM_MAX_ARRAYS];
+	unsigned int sizes[STREAM_MAX_ARRAYS];
+	unsigned int count;
+
+	StreamArrays() : count(0) {}
+	void add(const void* a, unsigned int size = 4) {
+		if (a != NULL && count < STREAM_MAX_ARRAYS) {
+			sizes[count] = size;
+			arrays[count++] = a;
+		}
+	}
+};
+
+#ifdef OUT_OF_CORE
+// advice for members [b, e) of every array, rounded out to whole pages
+inline void adviseMembers(const StreamArrays& s, unsigned int b, unsigned int e, int advice) {
+	static const std::size_t page = sysconf(_SC_PAGESIZE);
+	for (unsigned int a = 0; a < s.count; a++) {
+		std::size_t first = ((std::size_t) s.arrays[a] + ((std::size_t) b * s.sizes[a])) & ~(page - 1);
+		std::size_t last = (std::size_t) s.arrays[a] + ((std::size_t) e * s.sizes[a]);
+		if (last > first) {
+			madvise((void*) first, last - first, advice);
+		}
+	}
+}
+#endif
+
+// Calls f(chunkBegin, chunkEnd) over [begin, end) in STREAM_CHUNK pieces.
+// With OUT_OF_CORE the next piece of every array in s is asked for while the
+// current one is worked on, and finished pieces are marked cold (on kernels
+// that have MADV_COLD) so they are the first to be written back. Without it
+// this is f(begin, end). MORTON_REORDER keeps the pieces spatially coherent.
+template<typename F>
+void streamChunks(unsigned int begin, unsigned int end, const StreamArrays& s, F f) {
+#ifdef OUT_OF_CORE
+	for (unsigned int b = begin; b < end; b += STREAM_CHUNK) {
+		unsigned int e = end - b > STREAM_CHUNK ? b + STREAM_CHUNK : end;
+		if (e < end) {
+			adviseMembers(s, e, end - e > STREAM_CHUNK ? e + STREAM_CHUNK : end, MADV_WILLNEED);
+		}
+		f(b, e);
+#ifdef MADV_COLD
+		adviseMembers(s, b, e, MADV_COLD);
+#endif
+	}
+#else
+	(void) s;
+	f(begin, end);
+#endif
+}
@@ -0,0 +1,74 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Parallel.h"
+
+namespace {
+
+// set while the thread runs a worker's part of a loop
+thread_local bool inLoop = false;
+
+}  // namespace
+
+WorkerPool& WorkerPool::get() {
+	// never destroyed, so a loop run from another static's destructor at
+	// exit still finds its workers
+	static WorkerPool* pool = new WorkerPool();
+	return *pool;
+}
+
+WorkerPool::WorkerPool() : generation(0), job(NULL), context(NULL), active(0), pending(0) {
+	const unsigned int n = numWorkers();
+	threads.reserve(n - 1);
+	for (unsigned int w = 1; w < n; w++) {
+		threads.push_back(std::thread(&WorkerPool::loop, this, w));
+	}
+}
+
+void WorkerPool::loop(unsigned int w) {
+	workerIndex() = w;
+	unsigned long seen = 0;
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [&]() { return generation != seen; });
+		seen = generation;
+		if (w >= active) {
+			continue;
+		}
+		Job j = job;
+		void* c = context;
+		guard.unlock();
+		inLoop = true;
+		j(c, w);
+		inLoop = false;
+		guard.lock();
+		if (--pending == 0) {
+			done.notify_one();
+		}
+	}
+}
+
+void WorkerPool::run(Job j, void* c, unsigned int workers) {
+	if (workers <= 1 || workers > size() || inLoop || !busy.try_lock()) {
+		for (unsigned int w = 0; w < workers; w++) {
+			j(c, w);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = j;
+		context = c;
+		active = workers;
+		pending = workers - 1;
+		generation++;
+	}
+	wake.notify_all();
+	inLoop = true;
+	j(c, 0);
+	inLoop = false;
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [&]() { return pending == 0; });
+	}
+	busy.unlock();
+}
@@ -0,0 +1,116 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Trace.h"
+#include <cstdlib>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#pragma once
+
+// Which chunk of the running parallel loop the calling thread works on, 0
+// outside the loops. The counters report per worker with it.
+inline unsigned int& workerIndex() {
+	static thread_local unsigned int w = 0;
+	return w;
+}
+
+// Number of threads the parallel loops split their work over, one per core
+// or $PARTICLE_WORKERS. Read once, the WorkerPool is sized by it.
+inline unsigned int numWorkers() {
+	static const unsigned int n = []() {
+		const char* env = getenv("PARTICLE_WORKERS");
+		int w = env != NULL ? atoi(env) : (int) std::thread::hardware_concurrency();
+		return w > 0 ? (unsigned int) w : 1u;
+	}();
+	return n;
+}
+
+// The number of chunks parallelChunks splits n items into, so callers can
+// size per-worker scratch before the loop. Loops shorter than minChunk per
+// worker get fewer workers, down to running on the calling thread alone.
+inline unsigned int chunkWorkers(unsigned int n, unsigned int minChunk = 4096) {
+	unsigned int workers = numWorkers();
+	if (workers > n / minChunk) {
+		workers = n / minChunk;
+	}
+	return workers <= 1 ? 1 : workers;
+}
+
+// The threads the parallel loops run on, numWorkers() - 1 of them started
+// on first use and kept for the rest of the run, so a loop costs a wake-up
+// instead of starting and joining threads, and allocates nothing. Worker w
+// always runs on the same thread. One loop runs at a time: a loop started
+// inside another one, or from another thread while one is running, runs all
+// its workers' parts on the calling thread.
+class WorkerPool {
+public:
+	typedef void (*Job)(void* context, unsigned int worker);
+
+	static WorkerPool& get();
+	// job(context, w) for every w in [0, workers), 0 on the calling thread.
+	// Returns once they have all finished.
+	void run(Job job, void* context, unsigned int workers);
+	// the calling thread included
+	unsigned int size() const { return threads.size() + 1; }
+private:
+	std::vector<std::thread> threads;
+	// held by the running loop
+	std::mutex busy;
+	// guards everything below
+	std::mutex lock;
+	std::condition_variable wake, done;
+	unsigned long generation;
+	Job job;
+	void* context;
+	unsigned int active, pending;
+
+	WorkerPool();
+	void loop(unsigned int w);
+};
+
+// one parallelChunks call, handed to the pool without allocating
+template<typename F>
+struct ChunkJob {
+	F* f;
+	unsigned int begin, end, chunk;
+
+	static void run(void* context, unsigned int w) {
+		const ChunkJob& j = *static_cast<ChunkJob*>(context);
+		unsigned int b = j.begin + (w * j.chunk);
+		b = b < j.end ? b : j.end;
+		unsigned int e = (b + j.chunk < j.end) ? b + j.chunk : j.end;
+		TRACE_SCOPE("parallel chunk");
+		(*j.f)(w, b, e);
+	}
+};
+
+// Splits [begin, end) into chunkWorkers contiguous chunks and calls
+// f(worker, chunkBegin, chunkEnd) for each on the WorkerPool. The calling
+// thread runs the first chunk itself. The split only depends on the range,
+// so two loops over the same range see the same chunks.
+template<typename F>
+void parallelChunks(unsigned int begin, unsigned int end, F f, unsigned int minChunk = 4096) {
+	unsigned int n = end - begin;
+	unsigned int workers = chunkWorkers(n, minChunk);
+	if (workers == 1) {
+		f(0, begin, end);
+		return;
+	}
+	ChunkJob<F> j;
+	j.f = &f;
+	j.begin = begin;
+	j.end = end;
+	j.chunk = (n + workers - 1) / workers;
+	WorkerPool::get().run(ChunkJob<F>::run, &j, workers);
+}
+
+// Same split as parallelChunks but calls f(index) for every index.
+template<typename F>
+void parallelFor(unsigned int begin, unsigned int end, F f, unsigned int minChunk = 4096) {
+	parallelChunks(begin, end, [&f](unsigned int, unsigned int b, unsigned int e) {
+		for (unsigned int i = b; i < e; i++) {
+			f(i);
+		}
+	}, minChunk);
+}
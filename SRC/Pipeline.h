@@ -0,0 +1,178 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "ScalarBackend.h"
+#include "Parallel.h"
+#include "Weights.h"
+#include <math.h>
+#pragma once
+
+// A steering step built at compile time from a list of behaviors, each with
+// its weight as a std::ratio from Weights.h. PipelineBackend<Hunt<W>,
+// Align<W>, ...> runs every behavior of the list for a member before it
+// moves on to the next, in one pass over the flock, and a behavior that is
+// not in the list is not in the code. The weighted sum comes out the same as
+// CLHandler's one behavior at a time, to the last bit, for the same list.
+
+// What one member's behaviors read, set up once per flock and step.
+struct SteerView {
+	PosView me, prey, pred;
+	AngleView rot;
+	unsigned int preyCount, predCount;
+	const unsigned int* nearestPrey;
+	const unsigned int* nearestPred;
+	const float* predPos;
+	const float* avePos;
+	const float* aveRot;
+	const float* vels;
+	const float* sinT;
+	const float* cosT;
+
+	SteerView(FlockItem& f, const SteerInputs& in) : me(f.posView()), rot(f.angleView()),
+			preyCount(in.prey != NULL ? in.prey->getAmnt() : 0),
+			predCount(in.pred != NULL ? in.pred->getAmnt() : 0),
+			nearestPrey(in.nearestPrey), nearestPred(in.nearestPred), predPos(in.predPos),
+			avePos(in.avePos), aveRot(in.aveRot), vels(f.getVelsPtr()),
+			sinT(f.getHeadSinTPtr()), cosT(f.getHeadZPtr()) {
+		if (in.prey != NULL) {
+			prey = in.prey->posView();
+		}
+		if (in.pred != NULL) {
+			pred = in.pred->posView();
+		}
+	}
+
+	// steerAngles from member i towards (x, y, z)
+	void towards(unsigned int i, float x, float y, float z, float& t, float& e) const {
+		steerAngles(x - me.x(i), y - me.y(i), z - me.z(i), vels[i], sinT[i], cosT[i], t, e);
+	}
+};
+
+// turn towards the closest prey, skipped for the bottom flock
+template<typename W>
+struct Hunt {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		if (v.preyCount == 0) {
+			return;
+		}
+		unsigned int k = v.nearestPrey != NULL ? v.nearestPrey[i] :
+			nearestIndex(v.prey, v.preyCount, v.me.x(i), v.me.y(i), v.me.z(i));
+		float bt, be;
+		v.towards(i, v.prey.x(k), v.prey.y(k), v.prey.z(k), bt, be);
+		t += bt * weight<W>();
+		e += be * weight<W>();
+	}
+};
+
+// turn away from the closest predator, only for the flock that hides
+template<typename W>
+struct HideFromOne {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		if (v.predCount == 0) {
+			return;
+		}
+		unsigned int k = v.nearestPred != NULL ? v.nearestPred[i] :
+			nearestIndex(v.pred, v.predCount, v.me.x(i), v.me.y(i), v.me.z(i));
+		float bt, be;
+		v.towards(i, v.pred.x(k), v.pred.y(k), v.pred.z(k), bt, be);
+		t += -bt * weight<W>();
+		e += -be * weight<W>();
+	}
+};
+
+// turn away from the predators' centroid, only for the flock that hides
+template<typename W>
+struct HideFromAll {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		if (v.predPos == NULL) {
+			return;
+		}
+		float bt, be;
+		v.towards(i, v.predPos[0], v.predPos[1], v.predPos[2], bt, be);
+		t += -bt * weight<W>();
+		e += -be * weight<W>();
+	}
+};
+
+// turn towards the flock's average heading
+template<typename W>
+struct Align {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		t += fmod(v.aveRot[0] - v.rot.t(i), 3.14f) * weight<W>();
+		e += fmod(v.aveRot[1] - v.rot.e(i), (2.0f * 3.14f)) * weight<W>();
+	}
+};
+
+// turn away from the flock's centroid
+template<typename W>
+struct Seperate {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		float bt, be;
+		v.towards(i, v.avePos[0], v.avePos[1], v.avePos[2], bt, be);
+		t += -bt * weight<W>();
+		e += -be * weight<W>();
+	}
+};
+
+// turn towards the flock's centroid
+template<typename W>
+struct Cohere {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		float bt, be;
+		v.towards(i, v.avePos[0], v.avePos[1], v.avePos[2], bt, be);
+		t += bt * weight<W>();
+		e += be * weight<W>();
+	}
+};
+
+// every behavior in Bs for one member, in list order
+template<typename... Bs>
+struct Compose;
+
+template<>
+struct Compose<> {
+	static void add(const SteerView&, unsigned int, float&, float&) {}
+};
+
+template<typename B, typename... Rest>
+struct Compose<B, Rest...> {
+	static void add(const SteerView& v, unsigned int i, float& t, float& e) {
+		B::add(v, i, t, e);
+		Compose<Rest...>::add(v, i, t, e);
+	}
+};
+
+// The scalar backend plus a fused steer for the behaviors in Bs. The single
+// behaviors are still there for CHECK and the modes that steer without
+// steer(), LOCAL_FLOCKING and OCTREE_FIELDS.
+template<typename... Bs>
+class PipelineBackend : public ScalarBackend {
+private:
+	std::string name;
+public:
+	PipelineBackend(const std::string& scenario) : name("PIPELINE:" + scenario) {}
+	std::string getName() { return name; }
+
+	bool steer(FlockItem& me, const SteerInputs& in, float* t, float* e) {
+		const SteerView v(me, in);
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				for (unsigned int i = cb; i < ce; i++) {
+					float dt = 0.0f, de = 0.0f;
+					Compose<Bs...>::add(v, i, dt, de);
+					t[i] = dt;
+					e[i] = de;
+				}
+			});
+		}, 256);
+		return true;
+	}
+};
+
+// The prebuilt scenarios, see PipelineBackend.cpp for their names.
+// Every behavior, as CLHandler has always steered.
+typedef PipelineBackend<Hunt<HuntWeight>, HideFromOne<HideFromOneWeight>, HideFromAll<HideFromAllWeight>,
+	Align<AlignWeight>, Seperate<SeperateWeight>, Cohere<CohesionWeight> > PredatorPreyPipeline;
+// flocking alone, the flocks ignore each other
+typedef PipelineBackend<Align<AlignWeight>, Seperate<SeperateWeight>, Cohere<CohesionWeight> > FlockingPipeline;
+// the chase alone, with cohesion to keep each flock together
+typedef PipelineBackend<Hunt<HuntWeight>, HideFromOne<HideFromOneWeight>, Cohere<CohesionWeight> > PursuitPipeline;
@@ -0,0 +1,19 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Pipeline.h"
+#include <stdexcept>
+
+// PIPELINE:scenario, PREDATOR_PREY without a scenario
+static BackendPtr makePipeline(const BackendArgs& args) {
+	const std::string scenario = args.options.empty() ? "PREDATOR_PREY" : args.options;
+	if (scenario == "PREDATOR_PREY") {
+		return BackendPtr(new PredatorPreyPipeline(scenario));
+	} else if (scenario == "FLOCKING") {
+		return BackendPtr(new FlockingPipeline(scenario));
+	} else if (scenario == "PURSUIT") {
+		return BackendPtr(new PursuitPipeline(scenario));
+	}
+	throw std::runtime_error("Unknown pipeline " + scenario + ", there are PREDATOR_PREY, FLOCKING and PURSUIT");
+}
+
+static BackendRegistrar pipelineReg("PIPELINE", makePipeline);
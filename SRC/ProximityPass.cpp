@@ -0,0 +1,206 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "ProximityPass.h"
+#include "Parallel.h"
+
+// prey per worker chunk, each chunk is swept against every predator
+#define PREY_CHUNK 1024
+// consecutive particles that share a bounding box. Neighbours in the arrays
+// are only neighbours in space after a Morton reorder, without it the boxes
+// are too big to skip anything.
+#define PROXIMITY_BLOCK 64
+
+// min x, y, z then max x, y, z of each block of PROXIMITY_BLOCK, returns the
+// number of blocks
+static unsigned int fitBlocks(const PosView& p, unsigned int n, std::vector<float>& box) {
+	unsigned int blocks = (n + PROXIMITY_BLOCK - 1) / PROXIMITY_BLOCK;
+	box.resize(blocks * 6);
+	for (unsigned int k = 0; k < blocks; k++) {
+		float* bx = &box[k * 6];
+		unsigned int i = k * PROXIMITY_BLOCK;
+		unsigned int end = (i + PROXIMITY_BLOCK < n) ? i + PROXIMITY_BLOCK : n;
+		bx[0] = bx[3] = p.x(i);
+		bx[1] = bx[4] = p.y(i);
+		bx[2] = bx[5] = p.z(i);
+		for (i++; i < end; i++) {
+			float x = p.x(i), y = p.y(i), z = p.z(i);
+			bx[0] = x < bx[0] ? x : bx[0];
+			bx[1] = y < bx[1] ? y : bx[1];
+			bx[2] = z < bx[2] ? z : bx[2];
+			bx[3] = x > bx[3] ? x : bx[3];
+			bx[4] = y > bx[4] ? y : bx[4];
+			bx[5] = z > bx[5] ? z : bx[5];
+		}
+	}
+	return blocks;
+}
+
+// squared distance between two boxes from fitBlocks, 0 if they overlap
+static float blockGap2(const float* a, const float* b) {
+	float gap2 = 0.0f;
+	for (int k = 0; k < 3; k++) {
+		float gap = b[k] - a[k + 3];
+		float back = a[k] - b[k + 3];
+		gap = back > gap ? back : gap;
+		if (gap > 0.0f) {
+			gap2 += gap * gap;
+		}
+	}
+	return gap2;
+}
+
+// squared distance between the farthest corners of two boxes, no pair of
+// points in them is farther apart
+static float blockSpan2(const float* a, const float* b) {
+	float span2 = 0.0f;
+	for (int k = 0; k < 3; k++) {
+		float span = b[k + 3] - a[k];
+		float back = a[k + 3] - b[k];
+		span = back > span ? back : span;
+		span2 += span * span;
+	}
+	return span2;
+}
+
+void ProximityPass::build(FlockItem& pred, FlockItem& prey, float approximation) {
+	predCount = pred.getAmnt();
+	preyCount = prey.getAmnt();
+	const unsigned int m = predCount, n = preyCount;
+	nearestPrey.assign(m, 0);
+	nearestPred.assign(n, 0);
+	candStart.assign(m + 1, 0);
+	candidates.clear();
+	predIds.resize(m);
+	for (unsigned int p = 0; p < m; p++) {
+		predIds[p] = pred.getId(p);
+	}
+	if (m == 0 || n == 0) {
+		return;
+	}
+	const PosView pv = pred.posView();
+	const PosView qv = prey.posView();
+	const float reach = THRESHHOLD * THRESHHOLD;
+	// no pair can be in reach when the flocks' boxes are not
+	const bool capture = pred.boxGap2(prey) < reach;
+	// a block pair is skipped when it cannot beat a best by more than this
+	const float slack = (1.0f + approximation) * (1.0f + approximation);
+	const unsigned int predBlocks = fitBlocks(pv, m, predBox);
+	fitBlocks(qv, n, preyBox);
+
+	// each worker owns a contiguous run of prey, so the prey side results
+	// are written directly and only the predator side needs merging
+	const unsigned int workers = chunkWorkers(n, PREY_CHUNK);
+	workerDist.resize(workers);
+	workerNearest.resize(workers);
+	workerPairs.resize(workers);
+	workerWorst.resize(workers);
+	preyDist.assign(n, 99999999.9f); // large float
+	parallelChunks(0, n, [&](unsigned int w, unsigned int b, unsigned int e) {
+		std::vector<float>& dist = workerDist[w];
+		std::vector<unsigned int>& near = workerNearest[w];
+		std::vector<unsigned int>& pairs = workerPairs[w];
+		dist.assign(m, 99999999.9f);
+		near.assign(m, 0);
+		pairs.clear();
+		// a bound on the largest best distance in each predator block, then in
+		// each of this chunk's prey blocks. It starts at the closest block's
+		// far corner, which no best can end up above.
+		const unsigned int firstBlock = b / PROXIMITY_BLOCK;
+		const unsigned int lastBlock = (e - 1) / PROXIMITY_BLOCK;
+		std::vector<float>& worst = workerWorst[w];
+		worst.assign(predBlocks + (lastBlock - firstBlock) + 1, 99999999.9f);
+		float* preyWorst = worst.data() + predBlocks;
+		for (unsigned int pb = 0; pb < predBlocks; pb++) {
+			for (unsigned int qb = firstBlock; qb <= lastBlock; qb++) {
+				float far = blockSpan2(&predBox[pb * 6], &preyBox[qb * 6]);
+				worst[pb] = far < worst[pb] ? far : worst[pb];
+				preyWorst[qb - firstBlock] = far < preyWorst[qb - firstBlock] ? far : preyWorst[qb - firstBlock];
+			}
+		}
+		for (unsigned int pb = 0; pb < predBlocks; pb++) {
+			const unsigned int pBegin = pb * PROXIMITY_BLOCK;
+			const unsigned int pEnd = (pBegin + PROXIMITY_BLOCK < m) ? pBegin + PROXIMITY_BLOCK : m;
+			for (unsigned int qb = firstBlock; qb <= lastBlock; qb++) {
+				const unsigned int jBegin = (qb * PROXIMITY_BLOCK > b) ? qb * PROXIMITY_BLOCK : b;
+				const unsigned int jEnd = ((qb + 1) * PROXIMITY_BLOCK < e) ? (qb + 1) * PROXIMITY_BLOCK : e;
+				// nothing in the pair can be a capture or beat anyone's best
+				float gap = blockGap2(&predBox[pb * 6], &preyBox[qb * 6]);
+				if ((!capture || gap >= reach) && gap * slack > worst[pb] && gap * slack > preyWorst[qb - firstBlock]) {
+					continue;
+				}
+				// the prey block as floats, read once for all its predators
+				float x[PROXIMITY_BLOCK], y[PROXIMITY_BLOCK], z[PROXIMITY_BLOCK];
+				for (unsigned int j = jBegin; j < jEnd; j++) {
+					x[j - jBegin] = qv.x(j);
+					y[j - jBegin] = qv.y(j);
+					z[j - jBegin] = qv.z(j);
+				}
+				float predWorst = 0.0f;
+				for (unsigned int p = pBegin; p < pEnd; p++) {
+					float best = dist[p];
+					unsigned int bestIndex = near[p];
+					const float px = pv.x(p), py = pv.y(p), pz = pv.z(p);
+					for (unsigned int j = jBegin; j < jEnd; j++) {
+						float dx = x[j - jBegin] - px, dy = y[j - jBegin] - py, dz = z[j - jBegin] - pz;
+						float d = (dx * dx) + (dy * dy) + (dz * dz);
+						if (d < best) {
+							best = d;
+							bestIndex = j;
+						}
+						if (d < preyDist[j]) {
+							preyDist[j] = d;
+							nearestPred[j] = p;
+						}
+						if (capture && d < reach) {
+							pairs.push_back(p);
+							pairs.push_back(j);
+						}
+					}
+					dist[p] = best;
+					near[p] = bestIndex;
+					predWorst = best > predWorst ? best : predWorst;
+				}
+				worst[pb] = predWorst < worst[pb] ? predWorst : worst[pb];
+				float qWorst = 0.0f;
+				for (unsigned int j = jBegin; j < jEnd; j++) {
+					qWorst = preyDist[j] > qWorst ? preyDist[j] : qWorst;
+				}
+				preyWorst[qb - firstBlock] = qWorst < preyWorst[qb - firstBlock] ? qWorst : preyWorst[qb - firstBlock];
+			}
+		}
+	}, PREY_CHUNK);
+
+	// the chunks are in prey order, so a strict < keeps the lowest index
+	for (unsigned int p = 0; p < m; p++) {
+		float best = workerDist[0][p];
+		nearestPrey[p] = workerNearest[0][p];
+		for (unsigned int w = 1; w < workers; w++) {
+			if (workerDist[w][p] < best) {
+				best = workerDist[w][p];
+				nearestPrey[p] = workerNearest[w][p];
+			}
+		}
+	}
+
+	// counting sort of the pairs by predator, stable so each predator's
+	// candidates stay in prey order
+	for (unsigned int w = 0; w < workers; w++) {
+		for (unsigned int k = 0; k < workerPairs[w].size(); k += 2) {
+			candStart[workerPairs[w][k] + 1]++;
+		}
+	}
+	for (unsigned int p = 0; p < m; p++) {
+		candStart[p + 1] += candStart[p];
+	}
+	candidates.resize(candStart[m]);
+	for (unsigned int w = 0; w < workers; w++) {
+		for (unsigned int k = 0; k < workerPairs[w].size(); k += 2) {
+			// candStart[p] is used as the fill cursor and restored below
+			candidates[candStart[workerPairs[w][k]]++] = workerPairs[w][k + 1];
+		}
+	}
+	for (unsigned int p = m; p > 0; p--) {
+		candStart[p] = candStart[p - 1];
+	}
+	candStart[0] = 0;
+}
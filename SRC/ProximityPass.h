@@ -0,0 +1,52 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "FlockItem.h"
+#include <vector>
+#pragma once
+
+// Everything a step needs to know about how close one predator flock and
+// its prey flock are, from a single sweep over every predator/prey pair:
+// each predator's nearest prey for hunt, each prey's nearest predator for
+// hideFromClosestPackMember, and the prey in capture reach of each predator
+// for eatPrey. Ties go to the lowest index, the same as nearestIndex.
+// Valid until either flock moves.
+class ProximityPass {
+private:
+	unsigned int predCount, preyCount;
+	std::vector<unsigned int> nearestPrey, nearestPred;
+	// the prey within THRESHHOLD of predator p, in prey order, are
+	// candidates[candStart[p]] .. candidates[candStart[p + 1] - 1]
+	std::vector<unsigned int> candStart, candidates;
+	// the predators' ids, so eatPrey can still find them after its own
+	// predators have been eaten
+	std::vector<unsigned int> predIds;
+	// per worker partial results, merged at the end of build
+	std::vector<std::vector<float> > workerDist;
+	std::vector<std::vector<unsigned int> > workerNearest, workerPairs;
+	std::vector<float> preyDist;
+	// per block bounding boxes, the occupancy summary that lets build skip
+	// block pairs that cannot change any result
+	std::vector<float> predBox, preyBox;
+	std::vector<std::vector<float> > workerWorst;
+public:
+	ProximityPass() : predCount(0), preyCount(0) {}
+
+	// approximation > 0 lets a nearest member be up to 1 + approximation
+	// times farther than the true nearest, so more block pairs are skipped.
+	// The prey in capture reach are always exact.
+	void build(FlockItem& pred, FlockItem& prey, float approximation = 0.0f);
+
+	unsigned int getPredCount() const { return predCount; }
+	unsigned int getPreyCount() const { return preyCount; }
+	unsigned int getPredId(unsigned int p) const { return predIds[p]; }
+	// only meaningful when the other flock is not empty
+	const unsigned int* getNearestPrey() const { return nearestPrey.data(); }
+	const unsigned int* getNearestPred() const { return nearestPred.data(); }
+	// squared distance from each prey to its nearest predator
+	const float* getNearestPredDist2() const { return preyDist.data(); }
+	// number of prey in reach of predator p, list points at their indices
+	unsigned int getCandidates(unsigned int p, const unsigned int*& list) const {
+		list = candidates.data() + candStart[p];
+		return candStart[p + 1] - candStart[p];
+	}
+};
@@ -0,0 +1,132 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Publish.h"
+
+#ifdef PUBLISH
+#include "FlockItem.h"
+#include "Log.h"
+#include "Trace.h"
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+std::string shmName;
+char* base = NULL;
+size_t bytes = 0;
+PublishHeader* header = NULL;
+uint64_t published = 0;
+unsigned int steps = 0;
+
+PublishSlot* slotAt(uint64_t n) {
+	return (PublishSlot*) (base + sizeof(PublishHeader) + ((n % PUBLISH_SLOTS) * header->slotBytes));
+}
+
+void copyArray(float* to, const float* from, unsigned int n) {
+	if (n > 0) {
+		std::memcpy(to, from, n * sizeof(float));
+	}
+}
+
+}
+
+bool Publish::start(const std::string& name, std::vector<FlockItem>& flocks) {
+	if (flocks.size() > PUBLISH_MAX_FLOCKS) {
+		Log::text(Log::CONSOLE, "Too many flocks to publish, the step state is not published.");
+		return false;
+	}
+	// the slot's arrays, each starting on a cache line
+	uint64_t slotBytes = (sizeof(PublishSlot) + 63) & ~63ull;
+	uint64_t offsets[PUBLISH_MAX_FLOCKS];
+	uint32_t capacity[PUBLISH_MAX_FLOCKS];
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		// populate grows a flock by half and the run stops past the threshold
+		capacity[f] = ((2 * flocks[f].getThreshold()) + 15) & ~15u;
+		offsets[f] = slotBytes;
+		slotBytes += PUBLISH_ARRAYS * capacity[f] * sizeof(float);
+	}
+	bytes = sizeof(PublishHeader) + (PUBLISH_SLOTS * slotBytes);
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0) {
+		Log::text(Log::CONSOLE, "Could not create the shared memory " + name + ", the step state is not published.");
+		return false;
+	}
+	void* map = MAP_FAILED;
+	if (ftruncate(fd, bytes) == 0) {
+		map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		Log::text(Log::CONSOLE, "Could not map the shared memory " + name + ", the step state is not published.");
+		return false;
+	}
+	shmName = name;
+	base = (char*) map;
+	// fresh pages are zero, so every seq starts even and latest at 0
+	header = new (base) PublishHeader();
+	header->magic = PUBLISH_MAGIC;
+	header->version = PUBLISH_VERSION;
+	header->slots = PUBLISH_SLOTS;
+	header->flocks = flocks.size();
+	header->slotBytes = slotBytes;
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		header->arrayOffset[f] = offsets[f];
+		header->capacity[f] = capacity[f];
+		std::strncpy(header->names[f], flocks[f].getPName().c_str(), PUBLISH_NAME_LENGTH - 1);
+	}
+	for (unsigned int s = 0; s < PUBLISH_SLOTS; s++) {
+		new (slotAt(s)) PublishSlot();
+	}
+	header->latest.store(0, std::memory_order_release);
+	published = 0;
+	steps = 0;
+	return true;
+}
+
+void Publish::step(unsigned int generation, std::vector<FlockItem>& flocks) {
+	steps++;
+	if (header == NULL) {
+		return;
+	}
+	TRACE_SCOPE("publish");
+	PublishSlot* slot = slotAt(published);
+	const uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+	slot->seq.store(seq + 1, std::memory_order_relaxed);
+	// the odd seq is visible before any of the data changes
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->step = steps;
+	slot->generation = generation;
+	slot->flocks = header->flocks;
+	for (unsigned int f = 0; f < header->flocks; f++) {
+		FlockItem& flock = flocks[f];
+		flock.cacheHeadings();
+		const unsigned int n = (unsigned int) flock.getAmnt() < header->capacity[f] ? flock.getAmnt() : header->capacity[f];
+		const unsigned int cap = header->capacity[f];
+		float* to = (float*) ((char*) slot + header->arrayOffset[f]);
+		copyArray(to + (PUBLISH_POS_X * cap), flock.getPosXPtr(), n);
+		copyArray(to + (PUBLISH_POS_Y * cap), flock.getPosYPtr(), n);
+		copyArray(to + (PUBLISH_POS_Z * cap), flock.getPosZPtr(), n);
+		copyArray(to + (PUBLISH_HEAD_X * cap), flock.getHeadXPtr(), n);
+		copyArray(to + (PUBLISH_HEAD_Y * cap), flock.getHeadYPtr(), n);
+		copyArray(to + (PUBLISH_HEAD_Z * cap), flock.getHeadZPtr(), n);
+		slot->counts[f] = n;
+	}
+	slot->seq.store(seq + 2, std::memory_order_release);
+	header->latest.store(++published, std::memory_order_release);
+}
+
+void Publish::finish() {
+	if (header == NULL) {
+		return;
+	}
+	munmap(base, bytes);
+	shm_unlink(shmName.c_str());
+	header = NULL;
+	base = NULL;
+}
+#endif
@@ -0,0 +1,80 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Publish every finished step into POSIX shared memory (PUBLISH_NAME) for
+// other processes to watch the run, see Reader/PublishReader.cpp. Link with
+// -lrt on older glibc.
+// #define PUBLISH
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#pragma once
+
+#define PUBLISH_NAME "/particle_flocking"
+// 'FLCK'
+#define PUBLISH_MAGIC 0x4b434c46u
+#define PUBLISH_VERSION 1
+// steps kept, a reader has this many steps to finish with one
+#define PUBLISH_SLOTS 4
+#define PUBLISH_MAX_FLOCKS 16
+#define PUBLISH_NAME_LENGTH 32
+// the arrays every flock has in a slot, in this order
+#define PUBLISH_ARRAYS 6
+#define PUBLISH_POS_X 0
+#define PUBLISH_POS_Y 1
+#define PUBLISH_POS_Z 2
+#define PUBLISH_HEAD_X 3
+#define PUBLISH_HEAD_Y 4
+#define PUBLISH_HEAD_Z 5
+
+// The shared memory is this header, then PUBLISH_SLOTS slots of slotBytes
+// each. A slot is a PublishSlot, then for every flock its PUBLISH_ARRAYS
+// float arrays of capacity[f] each, starting at arrayOffset[f] from the slot.
+// Headings are unit vectors. The layout does not change during a run.
+struct PublishHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slots;
+	uint32_t flocks;
+	uint64_t slotBytes;
+	uint64_t arrayOffset[PUBLISH_MAX_FLOCKS];
+	uint32_t capacity[PUBLISH_MAX_FLOCKS];
+	// flock f is at level f
+	char names[PUBLISH_MAX_FLOCKS][PUBLISH_NAME_LENGTH];
+	// steps published so far, the newest is in slot (latest - 1) % slots
+	std::atomic<uint64_t> latest;
+};
+
+// Each slot is a seqlock: seq is odd while the slot is being written. A
+// reader loads seq (acquire), skips the slot if it is odd, reads what it
+// needs straight from the mapping, then fences (acquire) and loads seq
+// again. The read holds if seq did not change.
+struct PublishSlot {
+	std::atomic<uint64_t> seq;
+	uint64_t step;
+	uint32_t generation;
+	uint32_t flocks;
+	// members of each flock in this step, at most its capacity
+	uint32_t counts[PUBLISH_MAX_FLOCKS];
+};
+
+#ifdef PUBLISH
+#ifdef DISTRIBUTED
+#error "PUBLISH needs every member in one process, build it without DISTRIBUTED"
+#endif
+class FlockItem;
+
+// The simulation is the only writer. A step costs one copy of the positions
+// and cached headings, the readers never hold it up.
+class Publish {
+public:
+	// creates the shared memory, sized for twice every flock's threshold.
+	// False, and publishing nothing, if that fails.
+	static bool start(const std::string& name, std::vector<FlockItem>& flocks);
+	// one finished step
+	static void step(unsigned int generation, std::vector<FlockItem>& flocks);
+	// unmaps and removes the name, readers still mapping it keep their view
+	static void finish();
+};
+#endif
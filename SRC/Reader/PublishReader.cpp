@@ -0,0 +1,115 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Reference reader for the step state a PUBLISH build writes, see Publish.h.
+// Prints every flock's count and centre for each step it catches, reading
+// straight from the mapping without copying anything.
+//
+// g++ -std=c++11 -O2 PublishReader.cpp -o PublishReader (add -lrt on older glibc)
+// ./PublishReader [name] [steps]
+
+#include "../Publish.h"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// how often to look for a new step
+#define POLL_US 1000
+
+struct FlockView {
+	uint32_t count;
+	double x, y, z;
+};
+
+// reads slot n into view. False if the writer was in it, try again.
+bool readSlot(const PublishHeader* header, uint64_t n, uint64_t& step, uint32_t& generation, FlockView* view) {
+	const char* base = (const char*) header + sizeof(PublishHeader);
+	const PublishSlot* slot = (const PublishSlot*) (base + ((n % header->slots) * header->slotBytes));
+	const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+	if (seq & 1) {
+		return false;
+	}
+	step = slot->step;
+	generation = slot->generation;
+	for (unsigned int f = 0; f < header->flocks; f++) {
+		const float* a = (const float*) ((const char*) slot + header->arrayOffset[f]);
+		const uint32_t cap = header->capacity[f];
+		uint32_t count = slot->counts[f];
+		// a torn read can see any count, seq catches it below
+		count = count < cap ? count : cap;
+		double x = 0.0, y = 0.0, z = 0.0;
+		for (unsigned int i = 0; i < count; i++) {
+			x += a[(PUBLISH_POS_X * cap) + i];
+			y += a[(PUBLISH_POS_Y * cap) + i];
+			z += a[(PUBLISH_POS_Z * cap) + i];
+		}
+		view[f].count = count;
+		view[f].x = count > 0 ? x / count : 0.0;
+		view[f].y = count > 0 ? y / count : 0.0;
+		view[f].z = count > 0 ? z / count : 0.0;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->seq.load(std::memory_order_relaxed) == seq;
+}
+
+int main(int argc, char* argv[]) {
+	const char* name = argc > 1 ? argv[1] : PUBLISH_NAME;
+	const long limit = argc > 2 ? atol(argv[2]) : -1;
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		std::cerr << "Could not open " << name << ", is the simulation running with PUBLISH?\n";
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(PublishHeader)) {
+		std::cerr << name << " is too small\n";
+		close(fd);
+		return -1;
+	}
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		std::cerr << "Could not map " << name << "\n";
+		return -1;
+	}
+	const PublishHeader* header = (const PublishHeader*) map;
+	if (header->magic != PUBLISH_MAGIC || header->version != PUBLISH_VERSION
+			|| sizeof(PublishHeader) + (header->slots * header->slotBytes) > (size_t) st.st_size) {
+		std::cerr << name << " is not a version " << PUBLISH_VERSION << " step state\n";
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	FlockView view[PUBLISH_MAX_FLOCKS];
+	uint64_t seen = header->latest.load(std::memory_order_acquire);
+	long printed = 0, missed = 0;
+	while (limit < 0 || printed < limit) {
+		const uint64_t latest = header->latest.load(std::memory_order_acquire);
+		if (latest == seen) {
+			std::this_thread::sleep_for(std::chrono::microseconds(POLL_US));
+			continue;
+		}
+		uint64_t step;
+		uint32_t generation;
+		if (!readSlot(header, latest - 1, step, generation, view)) {
+			// the writer went round the ring meanwhile, take the newer step
+			continue;
+		}
+		missed += latest - seen - 1;
+		seen = latest;
+		std::cout << "step " << step << " generation " << generation;
+		for (unsigned int f = 0; f < header->flocks; f++) {
+			std::cout << "\t" << header->names[f] << " " << view[f].count << " at ("
+				<< view[f].x << ", " << view[f].y << ", " << view[f].z << ")";
+		}
+		std::cout << "\n";
+		printed++;
+	}
+	std::cout << printed << " steps read, " << missed << " skipped\n";
+	munmap(map, st.st_size);
+	return 0;
+}
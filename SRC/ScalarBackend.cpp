@@ -0,0 +1,119 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "ScalarBackend.h"
+#include <math.h>
+
+void ScalarBackend::huntRange(FlockItem& me, FlockItem& prey, const unsigned int* nearest,
+		float* t, float* e, unsigned int begin, unsigned int end) {
+	const PosView m = me.posView();
+	const PosView o = prey.posView();
+	for (unsigned int i = begin; i < end; i++) {
+		t[i] = e[i] = 0.0f;
+		if (prey.getAmnt() == 0) {
+			continue;
+		}
+		unsigned int k = nearest != NULL ? nearest[i] :
+			nearestIndex(o, prey.getAmnt(), m.x(i), m.y(i), m.z(i));
+		steerAngles(o.x(k) - m.x(i), o.y(k) - m.y(i), o.z(k) - m.z(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], t[i], e[i]);
+	}
+}
+
+void ScalarBackend::hideFromClosestRange(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+		float* t, float* e, unsigned int begin, unsigned int end) {
+	const PosView m = me.posView();
+	const PosView o = pred.posView();
+	for (unsigned int i = begin; i < end; i++) {
+		t[i] = e[i] = 0.0f;
+		if (pred.getAmnt() == 0) {
+			continue;
+		}
+		unsigned int k = nearest != NULL ? nearest[i] :
+			nearestIndex(o, pred.getAmnt(), m.x(i), m.y(i), m.z(i));
+		steerAngles(o.x(k) - m.x(i), o.y(k) - m.y(i), o.z(k) - m.z(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], t[i], e[i]);
+		t[i] = -t[i];
+		e[i] = -e[i];
+	}
+}
+
+void ScalarBackend::hideFromPackRange(FlockItem& me, const float* predPos, float* t, float* e,
+		unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		steerAngles(predPos[0] - me.getPosX(i), predPos[1] - me.getPosY(i), predPos[2] - me.getPosZ(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], t[i], e[i]);
+		t[i] = -t[i];
+		e[i] = -e[i];
+	}
+}
+
+void ScalarBackend::alignmentRange(FlockItem& me, const float* aveRot, float* t, float* e,
+		unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		t[i] = fmod(aveRot[0] - me.getRotTheta(i), 3.14f); // theta % 3.14f;
+		e[i] = fmod(aveRot[1] - me.getRotEpsilon(i), (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f
+	}
+}
+
+void ScalarBackend::seperationRange(FlockItem& me, const float* avePos, float* t, float* e,
+		unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		steerAngles(avePos[0] - me.getPosX(i), avePos[1] - me.getPosY(i), avePos[2] - me.getPosZ(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], t[i], e[i]);
+		t[i] = -t[i];
+		e[i] = -e[i];
+	}
+}
+
+void ScalarBackend::cohesionRange(FlockItem& me, const float* avePos, float* t, float* e,
+		unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		steerAngles(avePos[0] - me.getPosX(i), avePos[1] - me.getPosY(i), avePos[2] - me.getPosZ(i),
+			me.getVels(i), me.getHeadSinTPtr()[i], me.getHeadZPtr()[i], t[i], e[i]);
+	}
+}
+
+void ScalarBackend::hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest, float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		huntRange(me, prey, nearest, t, e, b, end);
+	});
+}
+
+void ScalarBackend::hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+		float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		hideFromClosestRange(me, pred, nearest, t, e, b, end);
+	});
+}
+
+void ScalarBackend::hideFromPack(FlockItem& me, const float* predPos, float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		hideFromPackRange(me, predPos, t, e, b, end);
+	});
+}
+
+void ScalarBackend::alignment(FlockItem& me, const float* aveRot, float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		alignmentRange(me, aveRot, t, e, b, end);
+	});
+}
+
+void ScalarBackend::seperation(FlockItem& me, const float* avePos, float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		seperationRange(me, avePos, t, e, b, end);
+	});
+}
+
+void ScalarBackend::cohesion(FlockItem& me, const float* avePos, float* t, float* e) {
+	streamChunks(0, me.getAmnt(), me.streamArrays(), [&](unsigned int b, unsigned int end) {
+		cohesionRange(me, avePos, t, e, b, end);
+	});
+}
+
+static BackendPtr makeScalar(const BackendArgs&) {
+	return BackendPtr(new ScalarBackend());
+}
+
+static BackendRegistrar scalarReg("SCALAR", makeScalar);
+// what (CPU|GPU) used to mean for a build without OpenCL
+static BackendRegistrar cpuReg("CPU", makeScalar);
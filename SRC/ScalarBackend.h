@@ -0,0 +1,31 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "StepBackend.h"
+#pragma once
+
+// The reference backend: plain loops on the calling thread. Each behavior
+// is written over a range of members so ThreadedBackend can split it.
+class ScalarBackend : public StepBackend {
+protected:
+	void huntRange(FlockItem& me, FlockItem& prey, const unsigned int* nearest,
+		float* t, float* e, unsigned int begin, unsigned int end);
+	void hideFromClosestRange(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+		float* t, float* e, unsigned int begin, unsigned int end);
+	void hideFromPackRange(FlockItem& me, const float* predPos, float* t, float* e,
+		unsigned int begin, unsigned int end);
+	void alignmentRange(FlockItem& me, const float* aveRot, float* t, float* e,
+		unsigned int begin, unsigned int end);
+	void seperationRange(FlockItem& me, const float* avePos, float* t, float* e,
+		unsigned int begin, unsigned int end);
+	void cohesionRange(FlockItem& me, const float* avePos, float* t, float* e,
+		unsigned int begin, unsigned int end);
+public:
+	std::string getName() { return "SCALAR"; }
+	void hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest, float* t, float* e);
+	void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+		float* t, float* e);
+	void hideFromPack(FlockItem& me, const float* predPos, float* t, float* e);
+	void alignment(FlockItem& me, const float* aveRot, float* t, float* e);
+	void seperation(FlockItem& me, const float* avePos, float* t, float* e);
+	void cohesion(FlockItem& me, const float* avePos, float* t, float* e);
+};
@@ -0,0 +1,169 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Scenario.h"
+#include "Parallel.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the members [begin, begin + count) of n that part gets, the first n % parts
+// parts get one more
+static void partRange(unsigned int n, unsigned int part, unsigned int parts,
+		unsigned int& begin, unsigned int& count) {
+	count = (n / parts) + (part < n % parts ? 1 : 0);
+	begin = (part * (n / parts)) + (part < n % parts ? part : n % parts);
+}
+
+static std::vector<FlockItem> loadText(const std::string& text, unsigned int part, unsigned int parts) {
+	std::vector<FlockItem> flocks;
+	std::istringstream lines(text);
+	std::string line;
+	int level = 0;
+	while (getline(lines, line)) {
+		if (line.empty() || line == "\r") {
+			continue;
+		}
+		std::size_t found = line.find("\t");
+		if (found == std::string::npos) {
+			throw std::runtime_error("Scenario line \"" + line + "\" is not name<tab>count");
+		}
+		std::string pName = line.substr(0, found);
+		unsigned int begin, count;
+		partRange(std::stoi(line.substr(found + 1)), part, parts, begin, count);
+		flocks.push_back(FlockItem(level, pName, count));
+		++level;
+	}
+	return flocks;
+}
+
+// reads n bytes at at, moving at past them
+static const char* take(const char*& at, const char* end, std::size_t n, const std::string& fileName) {
+	if ((std::size_t) (end - at) < n) {
+		throw std::runtime_error(fileName + " ends early");
+	}
+	const char* p = at;
+	at += n;
+	return p;
+}
+
+static uint32_t takeUint(const char*& at, const char* end, const std::string& fileName) {
+	uint32_t v;
+	std::memcpy(&v, take(at, end, sizeof(v), fileName), sizeof(v));
+	return v;
+}
+
+static std::vector<FlockItem> loadState(const char* data, std::size_t size, const std::string& fileName,
+		unsigned int part, unsigned int parts) {
+	const char* at = data;
+	const char* end = data + size;
+	take(at, end, strlen(SCENARIO_MAGIC), fileName);
+	if (takeUint(at, end, fileName) != SCENARIO_VERSION) {
+		throw std::runtime_error(fileName + " is not a version " + std::to_string(SCENARIO_VERSION) + " state file");
+	}
+	const uint32_t flockCount = takeUint(at, end, fileName);
+	std::vector<FlockItem> flocks;
+	flocks.reserve(flockCount);
+	for (uint32_t level = 0; level < flockCount; level++) {
+		const uint32_t length = takeUint(at, end, fileName);
+		std::string pName(take(at, end, length, fileName), length);
+		take(at, end, (4 - (length % 4)) % 4, fileName);
+		const uint32_t n = takeUint(at, end, fileName);
+		const float* arrays = (const float*) take(at, end, (std::size_t) n * SCENARIO_ARRAYS * sizeof(float), fileName);
+		unsigned int begin, count;
+		partRange(n, part, parts, begin, count);
+		const float* state[SCENARIO_ARRAYS];
+		for (int a = 0; a < SCENARIO_ARRAYS; a++) {
+			state[a] = arrays + ((std::size_t) a * n) + begin;
+		}
+		flocks.push_back(FlockItem(level, pName, count, state));
+	}
+	return flocks;
+}
+
+std::vector<FlockItem> loadScenario(const std::string& fileName, unsigned int part, unsigned int parts) {
+	TRACE_SCOPE("load scenario");
+	int fd = open(fileName.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		throw std::runtime_error("Could not open " + fileName);
+	}
+	const std::size_t size = st.st_size;
+	if (size == 0) {
+		close(fd);
+		return std::vector<FlockItem>();
+	}
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		throw std::runtime_error("Could not map " + fileName);
+	}
+	// the state arrays are read once, front to back
+	madvise(map, size, MADV_WILLNEED);
+	const char* data = (const char*) map;
+	std::vector<FlockItem> flocks;
+	try {
+		if (size >= strlen(SCENARIO_MAGIC) && std::memcmp(data, SCENARIO_MAGIC, strlen(SCENARIO_MAGIC)) == 0) {
+			flocks = loadState(data, size, fileName, part, parts);
+		} else {
+			flocks = loadText(std::string(data, size), part, parts);
+		}
+	} catch (...) {
+		munmap(map, size);
+		throw;
+	}
+	munmap(map, size);
+	return flocks;
+}
+
+static void writeUint(std::ofstream& out, uint32_t v) {
+	out.write((const char*) &v, sizeof(v));
+}
+
+bool saveScenario(const std::string& fileName, std::vector<FlockItem>& flocks) {
+	TRACE_SCOPE("save scenario");
+	std::ofstream out(fileName, std::ios::binary);
+	if (!out) {
+		return false;
+	}
+	out.write(SCENARIO_MAGIC, strlen(SCENARIO_MAGIC));
+	writeUint(out, SCENARIO_VERSION);
+	writeUint(out, flocks.size());
+	std::vector<float> scratch;
+	for (unsigned int f = 0; f < flocks.size(); f++) {
+		FlockItem& flock = flocks[f];
+		const std::string name = flock.getPName();
+		const char pad[4] = {0, 0, 0, 0};
+		writeUint(out, name.size());
+		out.write(name.data(), name.size());
+		out.write(pad, (4 - (name.size() % 4)) % 4);
+		const unsigned int n = flock.getAmnt();
+		writeUint(out, n);
+		out.write((const char*) flock.getPosXPtr(), n * sizeof(float));
+		out.write((const char*) flock.getPosYPtr(), n * sizeof(float));
+		out.write((const char*) flock.getPosZPtr(), n * sizeof(float));
+		// the angles are derived with CARTESIAN, so they go through scratch
+		scratch.resize(n);
+		parallelFor(0, n, [&](unsigned int i) {
+			scratch[i] = flock.getRotTheta(i);
+		});
+		out.write((const char*) scratch.data(), n * sizeof(float));
+		parallelFor(0, n, [&](unsigned int i) {
+			scratch[i] = flock.getRotEpsilon(i);
+		});
+		out.write((const char*) scratch.data(), n * sizeof(float));
+		parallelFor(0, n, [&](unsigned int i) {
+			scratch[i] = flock.getVels(i);
+		});
+		out.write((const char*) scratch.data(), n * sizeof(float));
+	}
+	return (bool) out.flush();
+}
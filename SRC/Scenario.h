@@ -0,0 +1,32 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "FlockItem.h"
+#include <string>
+#include <vector>
+#pragma once
+
+#define SCENARIO_MAGIC "FLKSTATE"
+#define SCENARIO_VERSION 1
+// the arrays a flock has in a state file, in this order
+#define SCENARIO_ARRAYS 6
+
+// The input files main takes, told apart by their first bytes.
+//
+// Text: one "name\tcount" line per flock, the lowest level first. The
+// members are placed at random.
+//
+// State: every member's starting state, as written by saveScenario. The
+// SCENARIO_MAGIC bytes, then uint32 SCENARIO_VERSION and the number of
+// flocks, then per flock a uint32 name length, the name, zero padding to 4
+// bytes, a uint32 member count and SCENARIO_ARRAYS float arrays of that
+// many: x, y, z, theta, epsilon, vel. Native byte order. The file is mapped
+// and each flock's arrays are copied in parallel straight into its own.
+// main writes one at the end of a run when $PARTICLE_SAVE_STATE names a
+// file, so a later run can go on from where it stopped. A distributed run
+// does not, each process only has its part of the flocks.
+//
+// With parts > 1 the caller gets its part of every flock, for splitting a
+// run over processes. Throws std::runtime_error for files it cannot read.
+std::vector<FlockItem> loadScenario(const std::string& fileName, unsigned int part = 0, unsigned int parts = 1);
+// writes flocks' current state as a state file, false if that fails
+bool saveScenario(const std::string& fileName, std::vector<FlockItem>& flocks);
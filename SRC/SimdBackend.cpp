@@ -0,0 +1,265 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "ScalarBackend.h"
+#include "Parallel.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+#ifdef HAVE_SSE2
+#ifdef COMPACT
+// four 16 bit values widened to float the way PosView does it
+static inline __m128 widen4(const int16_t* q, float origin, float step) {
+	__m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(q));
+	__m128i w = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+	return _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(_mm_cvtepi32_ps(w), _mm_set1_ps(step)));
+}
+#define LOAD4(v, a, j) widen4(v.q##a + (j), v.o##a, v.s##a)
+// and four angles from an AngleView, with no origin
+#define ANGLE4(v, a, j) widen4(v.q##a + (j), 0.0f, ANGLE_STEP)
+#else
+#define LOAD4(v, a, j) _mm_loadu_ps(v.p##a + (j))
+#define ANGLE4(v, a, j) _mm_loadu_ps(v.p##a + (j))
+#endif
+
+// nearestIndex four candidates at a time. Each lane keeps its first closest
+// candidate and the lanes are merged lowest index first on ties, so the
+// answer is the same one the scalar search gives.
+static unsigned int nearestIndex4(const PosView& p, unsigned int n, float px, float py, float pz) {
+	const __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py), vpz = _mm_set1_ps(pz);
+	const __m128i four = _mm_set1_epi32(4);
+	__m128 best = _mm_set1_ps(99999999.9f); // large float
+	__m128i bestIdx = _mm_setzero_si128();
+	__m128i idx = _mm_set_epi32(3, 2, 1, 0);
+	unsigned int j = 0;
+	for (; j + 4 <= n; j += 4) {
+		__m128 dx = _mm_sub_ps(LOAD4(p, x, j), vpx);
+		__m128 dy = _mm_sub_ps(LOAD4(p, y, j), vpy);
+		__m128 dz = _mm_sub_ps(LOAD4(p, z, j), vpz);
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+		best = _mm_min_ps(d, best);
+		bestIdx = _mm_or_si128(_mm_and_si128(closer, idx), _mm_andnot_si128(closer, bestIdx));
+		idx = _mm_add_epi32(idx, four);
+	}
+	float laneDist[4];
+	int laneIdx[4];
+	_mm_storeu_ps(laneDist, best);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(laneIdx), bestIdx);
+	float dist = 99999999.9f;
+	unsigned int index = 0;
+	for (int l = 0; l < 4; l++) {
+		if (laneDist[l] < dist || (laneDist[l] == dist && (unsigned int) laneIdx[l] < index)) {
+			dist = laneDist[l];
+			index = laneIdx[l];
+		}
+	}
+	// the tail comes after every lane's candidates, so strict < keeps ties first
+	for (; j < n; j++) {
+		float dx = p.x(j) - px, dy = p.y(j) - py, dz = p.z(j) - pz;
+		float myDist = (dx * dx) + (dy * dy) + (dz * dz);
+		if (myDist < dist) {
+			dist = myDist;
+			index = j;
+		}
+	}
+	return index;
+}
+// acos of four values in [-1, 1], Abramowitz and Stegun 4.4.46, within 4e-7
+// of acos, which CHECK's tolerance covers. NaN stays NaN.
+static inline __m128 acos4(__m128 x) {
+	const __m128 ax = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+	__m128 p = _mm_set1_ps(-0.0012624911f);
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(0.0066700901f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(-0.0170881256f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(0.0308918810f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(-0.0501743046f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(0.0889789874f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(-0.2145988016f));
+	p = _mm_add_ps(_mm_mul_ps(p, ax), _mm_set1_ps(1.5707963050f));
+	const __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), ax)), p);
+	const __m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(neg, _mm_sub_ps(_mm_set1_ps(3.14159265f), r)), _mm_andnot_ps(neg, r));
+}
+
+// fmod(x, y) of four values for y > 0. Exact while |x| < 2y, where it only
+// takes off one y, which is where the behaviors keep the angles; the other
+// lanes are left to fmod.
+static inline __m128 fmod4(__m128 x, float y) {
+	const __m128 vy = _mm_set1_ps(y), sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+	const __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(x, vy)));
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, vy));
+	// x / y rounded up to a whole number takes one y too many
+	const __m128 over = _mm_or_ps(_mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmplt_ps(r, zero)),
+		_mm_and_ps(_mm_cmplt_ps(x, zero), _mm_cmpgt_ps(r, zero)));
+	r = _mm_add_ps(r, _mm_and_ps(over, _mm_or_ps(_mm_and_ps(x, sign), vy)));
+	// also true for NaN
+	const __m128 far = _mm_cmpnlt_ps(_mm_andnot_ps(sign, x), _mm_set1_ps(2.0f * y));
+	if (_mm_movemask_ps(far) != 0) {
+		float xs[4], rs[4];
+		_mm_storeu_ps(xs, x);
+		_mm_storeu_ps(rs, r);
+		for (int l = 0; l < 4; l++) {
+			if (!(fabs(xs[l]) < 2.0f * y)) {
+				rs[l] = fmod(xs[l], y);
+			}
+		}
+		r = _mm_loadu_ps(rs);
+	}
+	return r;
+}
+
+// steerAngles for four members
+static inline void steerAngles4(__m128 ax, __m128 ay, __m128 az, __m128 vel, __m128 sinT, __m128 cosT,
+		__m128& theta, __m128& epsilon) {
+	const __m128 zero = _mm_setzero_ps(), lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+	const __m128 a = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)),
+		_mm_mul_ps(az, az)));
+	const __m128 b = _mm_andnot_ps(_mm_set1_ps(-0.0f), vel);
+	const __m128 none = _mm_or_ps(_mm_cmpeq_ps(a, zero), _mm_cmpeq_ps(b, zero));
+	const __m128 ab = _mm_mul_ps(a, b);
+	// NaN in the second operand of max and min, so it gets through the clamp
+	__m128 c = _mm_div_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ax, sinT), _mm_mul_ps(az, cosT)), vel), ab);
+	theta = acos4(_mm_min_ps(hi, _mm_max_ps(lo, c)));
+	c = _mm_div_ps(_mm_mul_ps(az, vel), ab);
+	epsilon = acos4(_mm_min_ps(hi, _mm_max_ps(lo, c)));
+	// acos is at most pi, so of the fmods only theta's can take anything off
+	const __m128 wrap = _mm_set1_ps(3.14f);
+	theta = _mm_sub_ps(theta, _mm_and_ps(_mm_cmpge_ps(theta, wrap), wrap));
+	theta = _mm_andnot_ps(none, theta);
+	epsilon = _mm_andnot_ps(none, epsilon);
+}
+#else
+#define nearestIndex4 nearestIndex
+#endif
+
+// The behaviors four members per instruction, split over the worker threads
+// as ThreadedBackend does. The turns are steerAngles', with acos from a
+// polynomial, so they differ from SCALAR's by a few 1e-7. The nearest member
+// searches hunt and hide do without a ProximityPass are four candidates per
+// instruction as well.
+class SimdBackend : public ScalarBackend {
+public:
+	std::string getName() { return "SIMD"; }
+
+	void hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest, float* t, float* e) {
+		steerNearest(me, prey, nearest, t, e, 1.0f);
+	}
+
+	void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+			float* t, float* e) {
+		steerNearest(me, pred, nearest, t, e, -1.0f);
+	}
+
+	void hideFromPack(FlockItem& me, const float* predPos, float* t, float* e) {
+		steerAt(me, predPos, t, e, -1.0f);
+	}
+
+	void alignment(FlockItem& me, const float* aveRot, float* t, float* e) {
+		// CARTESIAN derives the angles from the direction, getRotTheta does that
+#if defined(HAVE_SSE2) && !defined(CARTESIAN)
+		const AngleView r = me.angleView();
+#endif
+		split(me, [&](unsigned int b, unsigned int end) {
+			unsigned int i = b;
+#if defined(HAVE_SSE2) && !defined(CARTESIAN)
+			const __m128 aveT = _mm_set1_ps(aveRot[0]), aveE = _mm_set1_ps(aveRot[1]);
+			for (; i + 4 <= end; i += 4) {
+				_mm_storeu_ps(t + i, fmod4(_mm_sub_ps(aveT, ANGLE4(r, t, i)), 3.14f));
+				_mm_storeu_ps(e + i, fmod4(_mm_sub_ps(aveE, ANGLE4(r, e, i)), (2.0f * 3.14f)));
+			}
+#endif
+			alignmentRange(me, aveRot, t, e, i, end);
+		});
+	}
+
+	void seperation(FlockItem& me, const float* avePos, float* t, float* e) {
+		steerAt(me, avePos, t, e, -1.0f);
+	}
+
+	void cohesion(FlockItem& me, const float* avePos, float* t, float* e) {
+		steerAt(me, avePos, t, e, 1.0f);
+	}
+
+private:
+	// f(chunkBegin, chunkEnd) over me's members on the workers
+	template<typename F>
+	void split(FlockItem& me, F f) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), f);
+		}, 256);
+	}
+
+	// sign times the turn towards target(i) for members [b, end)
+	template<typename T>
+	void steerRange(FlockItem& me, float* t, float* e, float sign, unsigned int b, unsigned int end,
+			T target) {
+		const PosView m = me.posView();
+		const float* vel = me.getVelsPtr();
+		const float* sinT = me.getHeadSinTPtr();
+		const float* cosT = me.getHeadZPtr();
+		unsigned int i = b;
+#ifdef HAVE_SSE2
+		const __m128 s = _mm_set1_ps(sign);
+		for (; i + 4 <= end; i += 4) {
+			float x[4], y[4], z[4];
+			for (unsigned int l = 0; l < 4; l++) {
+				target(i + l, x[l], y[l], z[l]);
+			}
+			__m128 theta, epsilon;
+			steerAngles4(_mm_sub_ps(_mm_loadu_ps(x), LOAD4(m, x, i)), _mm_sub_ps(_mm_loadu_ps(y), LOAD4(m, y, i)),
+				_mm_sub_ps(_mm_loadu_ps(z), LOAD4(m, z, i)), _mm_loadu_ps(vel + i), _mm_loadu_ps(sinT + i),
+				_mm_loadu_ps(cosT + i), theta, epsilon);
+			_mm_storeu_ps(t + i, _mm_mul_ps(theta, s));
+			_mm_storeu_ps(e + i, _mm_mul_ps(epsilon, s));
+		}
+#endif
+		for (; i < end; i++) {
+			float x, y, z;
+			target(i, x, y, z);
+			steerAngles(x - m.x(i), y - m.y(i), z - m.z(i), vel[i], sinT[i], cosT[i], t[i], e[i]);
+			t[i] *= sign;
+			e[i] *= sign;
+		}
+	}
+
+	// towards or away from one point, the same for every member
+	void steerAt(FlockItem& me, const float* pos, float* t, float* e, float sign) {
+		split(me, [&](unsigned int b, unsigned int end) {
+			steerRange(me, t, e, sign, b, end, [&](unsigned int, float& x, float& y, float& z) {
+				x = pos[0];
+				y = pos[1];
+				z = pos[2];
+			});
+		});
+	}
+
+	void steerNearest(FlockItem& me, FlockItem& other, const unsigned int* nearest,
+			float* t, float* e, float sign) {
+		if (other.getAmnt() == 0) {
+			std::fill(t, t + me.getAmnt(), 0.0f);
+			std::fill(e, e + me.getAmnt(), 0.0f);
+			return;
+		}
+		const PosView m = me.posView();
+		const PosView o = other.posView();
+		split(me, [&](unsigned int b, unsigned int end) {
+			steerRange(me, t, e, sign, b, end, [&](unsigned int i, float& x, float& y, float& z) {
+				unsigned int k = nearest != NULL ? nearest[i] :
+					nearestIndex4(o, other.getAmnt(), m.x(i), m.y(i), m.z(i));
+				x = o.x(k);
+				y = o.y(k);
+				z = o.z(k);
+			});
+		});
+	}
+};
+
+static BackendPtr makeSimd(const BackendArgs&) {
+	return BackendPtr(new SimdBackend());
+}
+
+static BackendRegistrar simdReg("SIMD", makeSimd);
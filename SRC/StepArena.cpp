@@ -0,0 +1,67 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "StepArena.h"
+
+// keeps every buffer aligned for vector loads
+#define ARENA_ALIGN 64
+
+StepArena::StepArena(size_t initialBytes) {
+	blocks.push_back(std::vector<unsigned char>(initialBytes + ARENA_ALIGN));
+	blockIndex = 0;
+	blockUsed = 0;
+	stepUsed = 0;
+	highWater = 0;
+	blockAllocations = 1;
+}
+
+void* StepArena::allocBytes(size_t bytes) {
+	bytes = (bytes + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	if (bytes == 0) {
+		bytes = ARENA_ALIGN;
+	}
+	while (true) {
+		std::vector<unsigned char>& block = blocks[blockIndex];
+		// the start of the block is not aligned, skip ahead to the boundary
+		size_t base = (ARENA_ALIGN - (reinterpret_cast<size_t>(&block[0]) % ARENA_ALIGN)) % ARENA_ALIGN;
+		if (base + blockUsed + bytes <= block.size()) {
+			void* ret = &block[base + blockUsed];
+			blockUsed += bytes;
+			stepUsed += bytes;
+			return ret;
+		}
+		// this block is full, move on to the next one or grow a new one
+		blockIndex++;
+		blockUsed = 0;
+		if (blockIndex == blocks.size()) {
+			size_t size = 2 * blocks[blockIndex - 1].size();
+			if (size < bytes + ARENA_ALIGN) {
+				size = bytes + ARENA_ALIGN;
+			}
+			blocks.push_back(std::vector<unsigned char>(size));
+			blockAllocations++;
+		}
+	}
+}
+
+void StepArena::reset() {
+	if (stepUsed > highWater) {
+		highWater = stepUsed;
+	}
+	if (blocks.size() > 1) {
+		// fold the overflow blocks into one block that fits a whole step
+		blocks.clear();
+		blocks.push_back(std::vector<unsigned char>(highWater + ARENA_ALIGN));
+		blockAllocations++;
+	}
+	blockIndex = 0;
+	blockUsed = 0;
+	stepUsed = 0;
+}
+
+size_t StepArena::getHighWater() {
+	return highWater;
+}
+
+unsigned int StepArena::getBlockAllocations() {
+	return blockAllocations;
+}
@@ -0,0 +1,40 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <vector>
+#include <cstddef>
+#pragma once
+
+// Monotonic scratch memory for buffers that only live for one step.
+// Everything handed out is released together by reset(), and after the
+// first few steps one block sized to the high-water mark serves every
+// request, so a steady state step never touches the heap.
+class StepArena {
+private:
+	std::vector<std::vector<unsigned char> > blocks;
+	unsigned int blockIndex;
+	size_t blockUsed, stepUsed, highWater;
+	unsigned int blockAllocations;
+	void* allocBytes(size_t bytes);
+public:
+	StepArena(size_t initialBytes = 64 * 1024);
+
+	template<typename T>
+	T* alloc(size_t n) {
+		return static_cast<T*>(allocBytes(n * sizeof(T)));
+	}
+
+	template<typename T>
+	T* alloc(size_t n, T value) {
+		T* ret = alloc<T>(n);
+		for (size_t i = 0; i < n; i++) {
+			ret[i] = value;
+		}
+		return ret;
+	}
+
+	// releases everything allocated since the last reset
+	void reset();
+	size_t getHighWater();
+	// number of times the arena itself went to the heap
+	unsigned int getBlockAllocations();
+};
@@ -0,0 +1,37 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "StepBackend.h"
+#include <map>
+#include <stdexcept>
+
+typedef std::map<std::string, BackendFactory> Registry;
+
+// function local so it exists before any registrar runs
+static Registry& registry() {
+	static Registry reg;
+	return reg;
+}
+
+BackendRegistrar::BackendRegistrar(const std::string& name, BackendFactory factory) {
+	registry()[name] = factory;
+}
+
+BackendPtr makeBackend(const std::string& spec, const BackendArgs& args) {
+	std::size_t found = spec.find(":");
+	std::string name = spec.substr(0, found);
+	Registry::iterator it = registry().find(name);
+	if (it == registry().end()) {
+		throw std::runtime_error("Unknown backend " + name);
+	}
+	BackendArgs withOptions = args;
+	withOptions.options = (found == std::string::npos) ? "" : spec.substr(found + 1);
+	return it->second(withOptions);
+}
+
+std::vector<std::string> backendNames() {
+	std::vector<std::string> ret;
+	for (Registry::iterator it = registry().begin(); it != registry().end(); ++it) {
+		ret.push_back(it->first);
+	}
+	return ret;
+}
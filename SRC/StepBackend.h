@@ -0,0 +1,115 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "FlockItem.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <math.h>
+#pragma once
+
+// Everything a backend factory may need, filled in by main.
+struct BackendArgs {
+	// whatever followed the backend's name and a ':' in argv[1]
+	std::string options;
+	std::vector<std::string> kernelFiles;
+	std::vector<std::string> kernelFuncts;
+};
+
+// What a flock's behaviors read besides the flock itself, for steer.
+struct SteerInputs {
+	// the flock below and me's closest member of it, NULL for the bottom
+	// flock or an empty one
+	FlockItem* prey;
+	const unsigned int* nearestPrey;
+	// the flock above and its centroid, NULL unless me is the flock that
+	// hides. pred is also NULL when it is empty.
+	FlockItem* pred;
+	const unsigned int* nearestPred;
+	const float* predPos;
+	// me's average x, y, z and theta, epsilon
+	const float* avePos;
+	const float* aveRot;
+};
+
+// One implementation of the steering behaviors. Every backend reads the
+// FlockItem arrays directly and writes theta/epsilon turns into t and e (one
+// per member of me), so backends can be swapped or compared freely. me's
+// heading cache is filled before any behavior runs.
+class StepBackend {
+public:
+	virtual ~StepBackend() {}
+	virtual std::string getName() = 0;
+	// turn towards the closest member of prey. nearest[i] is the index in
+	// prey closest to me's i (see ProximityPass), or NULL to search for it;
+	// a backend that searches on its own anyway may ignore it.
+	virtual void hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest,
+		float* t, float* e) = 0;
+	// turn away from the closest member of pred, nearest as for hunt
+	virtual void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+		float* t, float* e) = 0;
+	// turn away from predPos, the predators' average x, y, z
+	virtual void hideFromPack(FlockItem& me, const float* predPos, float* t, float* e) = 0;
+	// turn towards aveRot, the flock's average theta, epsilon
+	virtual void alignment(FlockItem& me, const float* aveRot, float* t, float* e) = 0;
+	// turn away from avePos, the flock's average x, y, z
+	virtual void seperation(FlockItem& me, const float* avePos, float* t, float* e) = 0;
+	// turn towards avePos, the flock's average x, y, z
+	virtual void cohesion(FlockItem& me, const float* avePos, float* t, float* e) = 0;
+	// A backend that fuses the behaviors writes their weighted sum for every
+	// member into t and e here and returns true. The default returns false,
+	// and the behaviors above are called one at a time.
+	virtual bool steer(FlockItem&, const SteerInputs&, float*, float*) { return false; }
+	// totals worth logging at the end of a run, empty when there are none
+	virtual std::string report() { return ""; }
+};
+
+typedef std::shared_ptr<StepBackend> BackendPtr;
+typedef BackendPtr (*BackendFactory)(const BackendArgs& args);
+
+// Backends register themselves by name from their own translation unit, see
+// the static BackendRegistrar at the bottom of ScalarBackend.cpp.
+struct BackendRegistrar {
+	BackendRegistrar(const std::string& name, BackendFactory factory);
+};
+
+// spec is "NAME" or "NAME:options", throws std::runtime_error for unknown names
+BackendPtr makeBackend(const std::string& spec, const BackendArgs& args);
+std::vector<std::string> backendNames();
+
+// index of the point in p[0, n) closest to (px, py, pz), the first one on
+// ties and 0 when n is 0
+inline unsigned int nearestIndex(const PosView& p, unsigned int n, float px, float py, float pz) {
+	float dist = 99999999.9f; // large float
+	unsigned int index = 0;
+	for (unsigned int j = 0; j < n; j++) {
+		float dx = p.x(j) - px, dy = p.y(j) - py, dz = p.z(j) - pz;
+		float myDist = (dx * dx) + (dy * dy) + (dz * dz);
+		if (myDist < dist) {
+			dist = myDist;
+			index = j;
+		}
+	}
+	return index;
+}
+
+// The angle between (ax, ay, az) and the heading projected on epsilon = 0
+// and on theta = 0. These are the quantities the behaviors used to get from
+// the law of cosines, but a zero length vector turns nothing instead of
+// producing a NaN. sinT and cosT are the heading's, from the heading cache.
+inline void steerAngles(float ax, float ay, float az, float vel, float sinT, float cosT,
+		float& theta, float& epsilon) {
+	float a = sqrt((ax * ax) + (ay * ay) + (az * az));
+	float b = fabs(vel);
+	theta = epsilon = 0.0f;
+	if (a == 0.0f || b == 0.0f) {
+		return;
+	}
+	// 0 E: b = vel * (sin(T), 0, cos(T))
+	float c = ((ax * sinT) + (az * cosT)) * vel / (a * b);
+	theta = acos(c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c));
+	// 0 T: b = vel * (0, 0, 1)
+	c = az * vel / (a * b);
+	epsilon = acos(c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c));
+	theta = fmod(theta, 3.14f); // theta % 3.14f;
+	epsilon = fmod(epsilon, (2.0f * 3.14f)); // epsilon % (2.0f * 3.14)f;
+}
@@ -0,0 +1,67 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "ScalarBackend.h"
+#include "Parallel.h"
+
+// The scalar behaviors with each flock's members split over worker threads.
+// Every member only writes its own t[i] and e[i], so the chunks never share
+// an output.
+class ThreadedBackend : public ScalarBackend {
+public:
+	std::string getName() { return "THREADS"; }
+
+	void hunt(FlockItem& me, FlockItem& prey, const unsigned int* nearest, float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				huntRange(me, prey, nearest, t, e, cb, ce);
+			});
+		}, 256);
+	}
+
+	void hideFromClosestPackMember(FlockItem& me, FlockItem& pred, const unsigned int* nearest,
+			float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				hideFromClosestRange(me, pred, nearest, t, e, cb, ce);
+			});
+		}, 256);
+	}
+
+	void hideFromPack(FlockItem& me, const float* predPos, float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				hideFromPackRange(me, predPos, t, e, cb, ce);
+			});
+		});
+	}
+
+	void alignment(FlockItem& me, const float* aveRot, float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				alignmentRange(me, aveRot, t, e, cb, ce);
+			});
+		});
+	}
+
+	void seperation(FlockItem& me, const float* avePos, float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				seperationRange(me, avePos, t, e, cb, ce);
+			});
+		});
+	}
+
+	void cohesion(FlockItem& me, const float* avePos, float* t, float* e) {
+		parallelChunks(0, me.getAmnt(), [&](unsigned int, unsigned int b, unsigned int end) {
+			streamChunks(b, end, me.streamArrays(), [&](unsigned int cb, unsigned int ce) {
+				cohesionRange(me, avePos, t, e, cb, ce);
+			});
+		});
+	}
+};
+
+static BackendPtr makeThreaded(const BackendArgs&) {
+	return BackendPtr(new ThreadedBackend());
+}
+
+static BackendRegistrar threadedReg("THREADS", makeThreaded);
@@ -0,0 +1,229 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include "Trace.h"
+
+#ifdef TRACE
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+// events kept per run, recording stops once they are used up
+#define MAX_EVENTS (1 << 22)
+// the timeline's two processes
+#define HOST_PID 1
+#define DEVICE_PID 2
+
+namespace {
+
+struct Event {
+	const char* name;
+	unsigned long long begin, end;
+	// for device events, the submit time and whether this is the wait before
+	// the command ran
+	unsigned long long submit;
+	int pid, lane;
+	bool waiting;
+};
+
+struct Buffer {
+	std::vector<Event> events;
+	int lane;
+};
+
+std::atomic<bool> active(false);
+std::atomic<unsigned int> eventCount(0);
+std::chrono::steady_clock::time_point origin;
+std::string outName;
+
+// guards everything below, only taken when a thread starts or stops
+// recording and by finish
+std::mutex lock;
+std::vector<Buffer*> live;
+std::vector<Event> done;
+std::vector<int> freeLanes;
+int lanes = 0;
+int deviceLanes = 0;
+
+// hands the thread's events and lane back when it exits
+struct BufferHolder {
+	Buffer* buffer;
+	BufferHolder() : buffer(NULL) {}
+	~BufferHolder() {
+		if (buffer == NULL) {
+			return;
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		done.insert(done.end(), buffer->events.begin(), buffer->events.end());
+		freeLanes.push_back(buffer->lane);
+		for (unsigned int i = 0; i < live.size(); i++) {
+			if (live[i] == buffer) {
+				live[i] = live.back();
+				live.pop_back();
+				break;
+			}
+		}
+		delete buffer;
+	}
+};
+thread_local BufferHolder holder;
+
+Buffer* myBuffer() {
+	if (holder.buffer == NULL) {
+		Buffer* b = new Buffer();
+		std::lock_guard<std::mutex> guard(lock);
+		if (freeLanes.empty()) {
+			b->lane = lanes++;
+		} else {
+			// the lowest free lane, so lane 0 stays with the first thread
+			unsigned int low = 0;
+			for (unsigned int i = 1; i < freeLanes.size(); i++) {
+				if (freeLanes[i] < freeLanes[low]) {
+					low = i;
+				}
+			}
+			b->lane = freeLanes[low];
+			freeLanes[low] = freeLanes.back();
+			freeLanes.pop_back();
+		}
+		live.push_back(b);
+		holder.buffer = b;
+	}
+	return holder.buffer;
+}
+
+bool reserve(unsigned int n) {
+	return active.load(std::memory_order_relaxed)
+		&& eventCount.fetch_add(n, std::memory_order_relaxed) + n <= MAX_EVENTS;
+}
+
+void writeName(std::ofstream& out, const char* name) {
+	for (const char* c = name; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			out << '\\';
+		}
+		out << *c;
+	}
+}
+
+// microseconds, what the format's ts and dur are in
+void writeTime(std::ofstream& out, unsigned long long ns) {
+	out << (ns / 1000) << '.';
+	unsigned long long frac = ns % 1000;
+	out << (frac < 100 ? "0" : "") << (frac < 10 ? "0" : "") << frac;
+}
+
+void writeEvent(std::ofstream& out, const Event& e) {
+	out << "{\"name\":\"";
+	writeName(out, e.name);
+	out << (e.waiting ? " (queued)" : "") << "\",\"cat\":\""
+		<< (e.pid == HOST_PID ? "cpu" : (e.waiting ? "cl_wait" : "cl")) << "\",\"ph\":\"X\",\"pid\":"
+		<< e.pid << ",\"tid\":" << e.lane << ",\"ts\":";
+	writeTime(out, e.begin);
+	out << ",\"dur\":";
+	writeTime(out, e.end - e.begin);
+	if (e.pid == DEVICE_PID && e.waiting) {
+		out << ",\"args\":{\"submit_us\":";
+		writeTime(out, e.submit);
+		out << "}";
+	}
+	out << "}";
+}
+
+void writeMeta(std::ofstream& out, const char* what, int pid, int tid, const std::string& name) {
+	out << "{\"name\":\"" << what << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid
+		<< ",\"args\":{\"name\":\"" << name << "\"}}";
+}
+
+}  // namespace
+
+void Trace::start(const std::string& fileName) {
+	if (active.load()) {
+		return;
+	}
+	outName = fileName;
+	origin = std::chrono::steady_clock::now();
+	eventCount.store(0);
+	active.store(true);
+	// lane 0 is the thread that starts the trace
+	myBuffer();
+	static bool registered = false;
+	if (!registered) {
+		registered = true;
+		atexit(Trace::finish);
+	}
+}
+
+bool Trace::recording() {
+	return active.load(std::memory_order_relaxed);
+}
+
+unsigned long long Trace::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - origin).count();
+}
+
+void Trace::cpu(const char* name, unsigned long long begin, unsigned long long end) {
+	if (!reserve(1)) {
+		return;
+	}
+	Event e = {name, begin, end, 0, HOST_PID, 0, false};
+	Buffer* b = myBuffer();
+	e.lane = b->lane;
+	b->events.push_back(e);
+}
+
+void Trace::device(const char* name, int queue, unsigned long long queued,
+		unsigned long long submit, unsigned long long start, unsigned long long end) {
+	if (!reserve(2)) {
+		return;
+	}
+	Buffer* b = myBuffer();
+	Event wait = {name, queued, start, submit, DEVICE_PID, queue, true};
+	Event run = {name, start, end, 0, DEVICE_PID, queue, false};
+	b->events.push_back(wait);
+	b->events.push_back(run);
+	// only the thread running the backend records device commands
+	if (queue >= deviceLanes) {
+		deviceLanes = queue + 1;
+	}
+}
+
+void Trace::finish() {
+	if (!active.exchange(false)) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	std::ofstream out(outName.c_str());
+	if (!out) {
+		return;
+	}
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	writeMeta(out, "process_name", HOST_PID, 0, "host");
+	for (int i = 0; i < lanes; i++) {
+		out << ",\n";
+		writeMeta(out, "thread_name", HOST_PID, i, i == 0 ? "main" : "worker " + std::to_string(i));
+	}
+	out << ",\n";
+	writeMeta(out, "process_name", DEVICE_PID, 0, "OpenCL");
+	for (int i = 0; i < deviceLanes; i++) {
+		out << ",\n";
+		writeMeta(out, "thread_name", DEVICE_PID, i, "queue " + std::to_string(i));
+	}
+	for (unsigned int i = 0; i < done.size(); i++) {
+		out << ",\n";
+		writeEvent(out, done[i]);
+	}
+	for (unsigned int i = 0; i < live.size(); i++) {
+		for (unsigned int j = 0; j < live[i]->events.size(); j++) {
+			out << ",\n";
+			writeEvent(out, live[i]->events[j]);
+		}
+		live[i]->events.clear();
+	}
+	done.clear();
+	out << "\n]}\n";
+}
+#endif
@@ -0,0 +1,53 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+// Record a timeline of the run, written as Chrome trace event JSON (open it
+// in chrome://tracing or ui.perfetto.dev) when the run ends.
+// #define TRACE
+
+#include "Counters.h"
+#include <string>
+#pragma once
+
+#ifdef TRACE
+// Every thread records its TRACE_SCOPE begin/end pairs into a buffer of its
+// own, so recording takes no lock. Threads that do not overlap in time share
+// a lane in the timeline, so each of the WorkerPool's threads keeps one.
+// OpenCL commands get a lane per queue.
+class Trace {
+public:
+	// starts recording, the trace goes to fileName on finish()
+	static void start(const std::string& fileName);
+	// stops recording and writes the trace. Call it with no parallel loop
+	// running, it also runs at exit.
+	static void finish();
+	// host clock of the trace, nanoseconds since start()
+	static unsigned long long now();
+	// one CPU phase on the calling thread, name must outlive the trace
+	static void cpu(const char* name, unsigned long long begin, unsigned long long end);
+	// one OpenCL command on lane queue with its profiling times converted to
+	// the host clock: waiting from queued until start (submitted at submit),
+	// running from start until end
+	static void device(const char* name, int queue, unsigned long long queued,
+		unsigned long long submit, unsigned long long start, unsigned long long end);
+	static bool recording();
+};
+
+// times its scope as a CPU phase
+class TraceScope {
+private:
+	const char* name;
+	unsigned long long begin;
+public:
+	explicit TraceScope(const char* phase) : name(phase), begin(Trace::now()) {}
+	~TraceScope() {
+		Trace::cpu(name, begin, Trace::now());
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name); COUNTER_SCOPE(name)
+#else
+// the phases are also what the hardware counters count, see Counters.h
+#define TRACE_SCOPE(name) COUNTER_SCOPE(name)
+#endif
@@ -0,0 +1,26 @@
+// Copyright 2014 Aaron Baker (bakeraj4)
+
+#include <ratio>
+#pragma once
+
+// The steering behaviors' weights, the one place to tune them. The PIPELINE
+// backends build their behavior lists from the ratios at compile time, see
+// Pipeline.h, and CLHandler steers with the same values as doubles.
+typedef std::ratio<1, 100> HuntWeight;
+typedef std::ratio<1, 100> HideFromOneWeight;
+typedef std::ratio<1, 100> HideFromAllWeight;
+typedef std::ratio<4, 1000> AlignWeight;
+typedef std::ratio<4, 1000> SeperateWeight;
+typedef std::ratio<6, 1000> CohesionWeight;
+
+template<typename W>
+constexpr double weight() {
+	return (double) W::num / W::den;
+}
+
+constexpr double HUNT_W = weight<HuntWeight>();
+constexpr double HIDE_FROM_ONE_W = weight<HideFromOneWeight>();
+constexpr double HIDE_FROM_ALL_W = weight<HideFromAllWeight>();
+constexpr double ALIGN_W = weight<AlignWeight>();
+constexpr double SEPERATE_W = weight<SeperateWeight>();
+constexpr double COHESION_W = weight<CohesionWeight>();
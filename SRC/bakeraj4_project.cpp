@@ -4,8 +4,17 @@
 #include <vector>
 #include "FlockItem.h"
 #include "CLHandler.h"
+#include "StepBackend.h"
+#include "Log.h"
+#include "Trace.h"
+#include "Domain.h"
+#include "Publish.h"
+#include "Scenario.h"
+#include "Deadline.h"
+#include "Ensemble.h"
 #include <stdlib.h>
 #include <time.h>
+#include <chrono>
 #include <string> 
 #include <fstream>
 #include <unordered_map>
@@ -21,33 +30,64 @@ std::vector<Flock> allParticles;
 Colors c;
 CLHandler clH;
 float numMin;
-clock_t t;
+// wall time, clock() would count the CPU time of every thread
+std::chrono::steady_clock::time_point t;
 double timerInterval = 0.00001;
 int generations = 0;
 #define GENERATION 0.25f
 float genTime = GENERATION;
 float genTimer = GENERATION;
-std::ofstream output;
+#ifdef DEADLINE
+// every step's time and the fidelity it sets, see Deadline.h
+Deadline deadline;
+#endif
+// set once the experiment is over, the main loop returns after this frame
+bool finished = false;
+#ifdef DISTRIBUTED
+// this process's part of the run, see Domain.h
+Domain* domain = NULL;
+#endif
 
 void display(void); // forward declaration
 
-bool continueExperiment() {
-	float timePassed = ((((float)(clock() - t)) / CLOCKS_PER_SEC) / 60.0f);
-	std::cout << "Time passed = " << timePassed << "\n";
-	if (timePassed >= numMin) { 
-		return false;
+// every flock's member count, then every flock's threshold. Over every
+// process in a distributed run, so every process has to call it.
+std::vector<unsigned long long> flockCounts() {
+	std::vector<unsigned long long> counts(2 * allParticles.size());
+	for (unsigned int i = 0; i < allParticles.size(); i++) {
+		counts[i] = allParticles[i].getAmnt();
+		counts[allParticles.size() + i] = allParticles[i].getThreshold();
 	}
+#ifdef DISTRIBUTED
+	domain->sumAll(counts);
+#endif
+	return counts;
+}
+
+// minutes since the experiment started
+float minutesPassed() {
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - t).count() / 60.0f;
+}
+
+bool continueExperiment() {
+	std::vector<unsigned long long> counts = flockCounts();
+	float timePassed = minutesPassed();
+	Log::progress(timePassed);
+	bool go = timePassed < numMin;
 	for (unsigned int i = 0; i < allParticles.size(); i++) {
-		if (allParticles[i].getAmnt() == 0 || allParticles[i].getAmnt() > allParticles[i].getThreshold()) {
-			return false;
+		if (counts[i] == 0 || counts[i] > counts[allParticles.size() + i]) {
+			go = false;
 		}
 	}
-	return true;
+#ifdef DISTRIBUTED
+	// the processes' clocks differ, the first one's decides
+	go = domain->fromFirst(go);
+#endif
+	return go;
 }
 
 std::vector<std::string> kernelFiles() {
 	std::vector<std::string> ret;
-	ret.push_back("averagePosRot.cl");
 	ret.push_back("hunt.cl");
 	ret.push_back("hideFromHunter.cl");
 	ret.push_back("hideFromHunters.cl");
@@ -59,7 +99,6 @@ std::vector<std::string> kernelFiles() {
 
 std::vector<std::string> kernelFuncts() {
 	std::vector<std::string> ret;
-	ret.push_back("avePosRot");
 	ret.push_back("hunt");
 	ret.push_back("hideFromHunter");
 	ret.push_back("hideFromHunters");
@@ -69,33 +108,72 @@ std::vector<std::string> kernelFuncts() {
 	return ret;
 }
 
+// one generation's block in the log file
+void logGeneration(int number, float seconds) {
+	std::vector<unsigned long long> counts = flockCounts();
+	Log::generation(number, seconds);
+	for (unsigned int i = 0; i < allParticles.size(); i++) {
+		Log::flock(allParticles[i].getPName(), counts[i], allParticles[i].getLevel());
+	}
+	Log::endGeneration();
+}
+
 void moveAllFlocks() {
+	TRACE_SCOPE("move flocks");
 	for (unsigned int i = allParticles.size(); i > 0; i--) {
 		if (i != 1 ) {
-			allParticles[i - 1].eatPrey(allParticles[i - 2]);
+			allParticles[i - 1].eatPrey(allParticles[i - 2], clH.getProximity(i - 1));
 		}
+#ifdef DISTRIBUTED
+		// done being prey and predator for this step
+		domain->dropHalos(allParticles[i - 1]);
+#endif
 		allParticles[i - 1].move();
 	}
+#ifdef DISTRIBUTED
+	domain->migrate(allParticles);
+#endif
 	if (continueExperiment()) {
-		float timePassed = ((((float)(clock() - t)) / CLOCKS_PER_SEC) / 60.0f);
-		if (timePassed >= genTime) {
+		float timePassed = minutesPassed();
+		bool nextGeneration = timePassed >= genTime;
+#ifdef DISTRIBUTED
+		nextGeneration = domain->fromFirst(nextGeneration);
+#endif
+		if (nextGeneration) {
 			generations++;
 			genTime += GENERATION;
-			output << "Generation " << generations << " at time " << timePassed << " seconds\n";
 			for (unsigned int i = 0; i < allParticles.size(); i++) {
 				allParticles[i].populate(clH.getAvePosX()[i], clH.getAvePosY()[i], clH.getAvePosZ()[i]);
-				output << allParticles[i].toString() << "\n";
 			}
-			output << "*******************************************************************************\n";
+			logGeneration(generations, timePassed);
 		 }
+#ifdef PUBLISH
+		Publish::step(generations, allParticles);
+#endif
 	} else {
-		// closes the file
-		output.close();
-		// terminate the program with sucess
-		exit(0);
+		// main flushes the log once the loop returns
+		finished = true;
+#ifndef DISTRIBUTED
+		glutLeaveMainLoop();
+#endif
 	}
 }
 
+#ifdef DEADLINE
+// ends a timed step and passes a new fidelity on to the step
+void endTimedStep() {
+	bool changed = deadline.endStep();
+#ifdef DISTRIBUTED
+	// the processes step in lock step, so they take the first one's level
+	changed = deadline.setLevel(domain->fromFirst(deadline.getLevel())) || changed;
+#endif
+	if (changed) {
+		const Fidelity& f = deadline.getFidelity();
+		clH.setFidelity(f.steerPeriod, f.approximation);
+	}
+}
+#endif
+
 void sphere() {
 	glutSolidSphere(0.01, SLICES, STACKS);
 }
@@ -116,6 +194,17 @@ void setColor(unsigned int num) {
 }
 
 void display(void) {
+	if (finished) {
+		return;
+	}
+	TRACE_SCOPE("frame");
+#ifdef DEADLINE
+	// the budget is for the whole frame, drawing included
+	deadline.startStep();
+	const int drawStride = (int) deadline.getFidelity().drawStride;
+#else
+	const int drawStride = 1;
+#endif
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	glMatrixMode(GL_MODELVIEW);
@@ -125,36 +214,38 @@ void display(void) {
 	glLineWidth(4);
 	for (unsigned int i = 0; i < allParticles.size(); i++) {
 		setColor(i);
-		for(unsigned int j = 0; j < allParticles[i].getAmnt(); j++) {
+		for(int j = 0; j < allParticles[i].getAmnt(); j += drawStride) {
 			IT(1, 1, 1, allParticles[i].getPosX(j), allParticles[i].getPosY(j), allParticles[i].getPosZ(j), 0, 0, 1, 0);
 		}
 	}
 
-	glFlush();
-	glutSwapBuffers();
+	{
+		TRACE_SCOPE("swap buffers");
+		glFlush();
+		glutSwapBuffers();
+	}
 	clH.oneIterationOfFlocking();
 	moveAllFlocks();
+#ifdef DEADLINE
+	endTimedStep();
+#endif
 
 	// call it back
 	glutPostRedisplay();
 }
 
+// a name<tab>count scenario or a state file, see Scenario.h
 std::vector<Flock> makeAllParticles(std::string& fileName) {
-	std::ifstream file(fileName);
-	std::string pName, line;
-	int level = 0, amnt;
-	std::vector<Flock> particles;
-	std::size_t found;
-	while (getline(file, line)) {
-		found = line.find("\t");
-		pName = line.substr(0, found);
-		amnt = stoi(line.substr(found + 1));
-		particles.push_back(FlockItem(level, pName, amnt));
-		++level;
+#ifdef DISTRIBUTED
+	// every process makes its share, migrate sorts them into the slabs
+	std::vector<Flock> particles = loadScenario(fileName, domain->getRank(), domain->getRanks());
+	for (unsigned int i = 0; i < particles.size(); i++) {
+		particles[i].setIdStride(domain->getRank(), domain->getRanks());
 	}
-	
-	file.close();
 	return particles;
+#else
+	return loadScenario(fileName);
+#endif
 }
 
 void setUpColors() {
@@ -244,40 +335,197 @@ void openGLSetUp() {
 	glLightfv(GL_LIGHT0, GL_POSITION, pos);
 }
 
+#ifdef ENSEMBLE
+// the headless loop of an ensemble run, see Ensemble.h
+int runEnsemble(const std::string& device, const std::string& listFile) {
+	Ensemble* ensemble = NULL;
+	try {
+		ensemble = new Ensemble(listFile, device);
+	} catch (const std::exception& ex) {
+		Log::text(Log::CONSOLE, ex.what());
+		Log::shutdown();
+		return -1;
+	}
+	ensemble->logGeneration(0, 0.0f);
+	t = std::chrono::steady_clock::now();
+	float timePassed = 0.0f;
+	while (ensemble->running() && timePassed < numMin) {
+		ensemble->step();
+		timePassed = minutesPassed();
+		Log::progress(timePassed);
+		if (timePassed >= genTime) {
+			generations++;
+			genTime += GENERATION;
+			ensemble->populate();
+			ensemble->logGeneration(generations, timePassed);
+		}
+	}
+	Log::text(Log::CONSOLE, ensemble->report());
+	delete ensemble;
+	Log::shutdown();
+	return 0;
+}
+#endif
+
 int main(int argc, char* argv[]) {
+#ifdef DISTRIBUTED
+	MPI_Init(&argc, &argv);
+	domain = new Domain();
+#endif
     if (argc != 4) {
+		std::string names;
+		std::vector<std::string> all = backendNames();
+		for (unsigned int i = 0; i < all.size(); i++) {
+			names += (i == 0 ? "" : "|") + all[i];
+		}
+#ifdef ENSEMBLE
+		names = "CPU|GPU|ACC";
+#endif
         std::cout << "There were not engough parameters.\n"
-		    << "There needs to be <(CPU|GPU) (input file) (mins to run)>.\n"
+#ifdef ENSEMBLE
+		    << "There needs to be <(" << names << ") (file listing one input file per line) (mins to run)>.\n"
+#else
+		    << "There needs to be <(" << names << ")[:options] (input file) (mins to run)>.\n"
+#endif
+#ifdef CARTESIAN
+			<< "This build steers with CARTESIAN, which does not use the backend.\n"
+#endif
 			<< "The user provided " << argc << " many arguments.\nAnd they are:\n";
 			for (int i = 0; i < argc; i++ ) {
 				std::cout << argv[i] << "\n";
 			}
+#ifdef DISTRIBUTED
+		// every process was given the same arguments, so they all end here
+		delete domain;
+		MPI_Finalize();
+#endif
 		return -1;
     }
-	// creates my log file
-	output.open("ParticleTest.dat");
+#ifdef DISTRIBUTED
+	// only the first process logs, the others' records are dropped
+	if (domain->getRank() == 0) {
+#endif
+	// creates my log file and the thread that writes it
+	if (!Log::start("ParticleTest.dat")) {
+		Log::text(Log::CONSOLE, "Could not open ParticleTest.dat, generations are only logged to the console.");
+	}
+#ifndef DISTRIBUTED
+	// the in-situ statistics, see Analytics.h
+	if (Log::open(Log::STATS_FILE, "ParticleStats.tsv")) {
+		Log::text(Log::STATS_FILE, Analytics::header());
+	}
+#else
+	}
+#endif
 	// seeding random numbers
+#ifdef DISTRIBUTED
+	srand(domain->fromFirst(time(NULL)) + domain->getRank());
+#else
 	srand(time(NULL));
+#endif
 	// file name of input file
 	std::string file(argv[2]);
+#ifdef ENSEMBLE
+	numMin = std::stof(argv[3]);
+	return runEnsemble(argv[1], file);
+#endif
 	// creates the particles
-	allParticles = makeAllParticles(file);
-	// write intro stuff
-	output << "Generation 0 (input) at time = 0.0 seconds\n";
-	for (unsigned int i = 0; i < allParticles.size(); i++) {
-		output << allParticles[i].toString() << "\n";
+	try {
+		allParticles = makeAllParticles(file);
+	} catch (const std::exception& ex) {
+		Log::text(Log::CONSOLE, ex.what());
+#ifdef DISTRIBUTED
+		Log::shutdown();
+		MPI_Abort(MPI_COMM_WORLD, -1);
+#endif
+		return -1;
 	}
-	output << "*******************************************************************************\n";
+#ifdef DISTRIBUTED
+	domain->migrate(allParticles);
+#endif
+	// write intro stuff
+	logGeneration(0, 0.0f);
+#ifdef PUBLISH
+	Publish::start(PUBLISH_NAME, allParticles);
+#endif
+#ifndef DISTRIBUTED
 	// creates my color map
 	setUpColors();
 	// OpenGL things
 	glutInit(&argc, argv);
+	// glutLeaveMainLoop and closing the window return from glutMainLoop
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 	openGLSetUp();
+#endif
 	// pointer to the particles
 	std::vector<Flock>* ptr = &allParticles;
-	clH = CLHandler(ptr, kernelFiles(), kernelFuncts(), std::string(argv[1]));
+	try {
+		clH = CLHandler(ptr, kernelFiles(), kernelFuncts(), std::string(argv[1]));
+	} catch (const std::exception& ex) {
+		Log::text(Log::CONSOLE, ex.what());
+#ifdef DISTRIBUTED
+		Log::shutdown();
+		MPI_Abort(MPI_COMM_WORLD, -1);
+#endif
+		return -1;
+	}
 
 	numMin = std::stof(argv[3]);
-	t  = clock();
+#ifdef TRACE
+	Trace::start("ParticleTrace.json");
+#endif
+#ifdef COUNTERS
+	Counters::start("ParticleCounters.txt");
+#endif
+	t = std::chrono::steady_clock::now();
+#ifdef DISTRIBUTED
+	// headless, every process steps its slab in lock step
+	while (!finished) {
+		domain->exchangeHalos(allParticles);
+#ifdef DEADLINE
+		deadline.startStep();
+#endif
+		clH.setGlobalSums(domain->getSums());
+		clH.oneIterationOfFlocking();
+		moveAllFlocks();
+#ifdef DEADLINE
+		endTimedStep();
+#endif
+	}
+#else
 	glutMainLoop();
+#endif
+#ifdef TRACE
+	Trace::finish();
+#endif
+#ifdef COUNTERS
+	Counters::report();
+#endif
+#ifdef PUBLISH
+	Publish::finish();
+#endif
+#ifndef DISTRIBUTED
+	// the final state, to start a later run from, see Scenario.h
+	const char* saveTo = getenv("PARTICLE_SAVE_STATE");
+	if (saveTo != NULL && !saveScenario(saveTo, allParticles)) {
+		Log::text(Log::CONSOLE, std::string("Could not write the state file ") + saveTo);
+	}
+#endif
+	const std::string backendReport = clH.backendReport();
+	if (!backendReport.empty()) {
+		Log::text(Log::CONSOLE, backendReport);
+	}
+#ifdef COMPACT
+	// what the 16 bit positions cost against float ones
+	for (unsigned int i = 0; i < allParticles.size(); i++) {
+		Log::text(Log::CONSOLE, allParticles[i].precisionReport());
+	}
+#endif
+	// write out everything still queued
+	Log::shutdown();
+#ifdef DISTRIBUTED
+	delete domain;
+	MPI_Finalize();
+#endif
+	return 0;
 }